@@ -0,0 +1,86 @@
+/**
+ * @file EthIpv4Udp.hpp
+ * @brief Hand-rolled Ethernet/IPv4/UDP framing for the raw (kernel bypass) paths.
+ *
+ * No IP options on transmit, no IP fragments, UDP checksum left at 0 (allowed on IPv4).
+ */
+
+#ifndef ETH_IPV4_UDP_HPP
+#define ETH_IPV4_UDP_HPP
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+class EthIpv4Udp {
+public:
+    static const size_t ETH_HEADER_LEN = 14;
+    static const size_t IP_HEADER_LEN = 20;      // Without options
+    static const size_t UDP_HEADER_LEN = 8;
+    static const size_t HEADERS_LEN = ETH_HEADER_LEN + IP_HEADER_LEN + UDP_HEADER_LEN;
+
+    /**
+     * @brief Locate the UDP payload of an Ethernet/IPv4/UDP frame for 'port'.
+     * @return false if the frame is not such a packet (or is truncated).
+     */
+    static bool parse(const uint8_t* frame, size_t len, uint16_t port, const uint8_t*& payload, size_t& payload_len) {
+        if (len < HEADERS_LEN) return false;
+        if (frame[12] != 0x08 || frame[13] != 0x00) return false;        // EtherType IPv4
+        const uint8_t* ip = frame + ETH_HEADER_LEN;
+        size_t ihl = static_cast<size_t>(ip[0] & 0x0f) * 4;
+        if ((ip[0] >> 4) != 4 || ihl < IP_HEADER_LEN || ip[9] != IPPROTO_UDP) return false;
+        if (len < ETH_HEADER_LEN + ihl + UDP_HEADER_LEN) return false;
+        const uint8_t* udp = ip + ihl;
+        if (((udp[2] << 8) | udp[3]) != port) return false;
+        size_t udp_len = static_cast<size_t>((udp[4] << 8) | udp[5]);
+        size_t available = len - ETH_HEADER_LEN - ihl;
+        if (udp_len < UDP_HEADER_LEN || udp_len > available) return false;
+        payload = udp + UDP_HEADER_LEN;
+        payload_len = udp_len - UDP_HEADER_LEN;
+        return true;
+    }
+
+    /**
+     * @brief Write Ethernet/IPv4/UDP headers (HEADERS_LEN bytes) for 'payload_len' bytes.
+     * Addresses and ports are in network byte order. The UDP checksum is left at 0 (allowed on IPv4).
+     */
+    static void build(uint8_t* frame, const uint8_t src_mac[6], const uint8_t dst_mac[6],
+                      uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
+                      uint16_t ip_id, size_t payload_len) {
+        std::memcpy(frame, dst_mac, 6);
+        std::memcpy(frame + 6, src_mac, 6);
+        frame[12] = 0x08;
+        frame[13] = 0x00;
+
+        uint8_t* ip = frame + ETH_HEADER_LEN;
+        uint16_t ip_len = htons(static_cast<uint16_t>(IP_HEADER_LEN + UDP_HEADER_LEN + payload_len));
+        uint16_t id = htons(ip_id);
+        ip[0] = 0x45;
+        ip[1] = 0;
+        std::memcpy(ip + 2, &ip_len, 2);
+        std::memcpy(ip + 4, &id, 2);
+        ip[6] = 0x40;   // Don't Fragment
+        ip[7] = 0;
+        ip[8] = 64;     // TTL
+        ip[9] = IPPROTO_UDP;
+        ip[10] = ip[11] = 0;
+        std::memcpy(ip + 12, &src_ip, 4);
+        std::memcpy(ip + 16, &dst_ip, 4);
+        uint32_t sum = 0;
+        for (size_t i = 0; i < IP_HEADER_LEN; i += 2) sum += static_cast<uint32_t>(ip[i] << 8 | ip[i + 1]);
+        while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+        uint16_t check = htons(static_cast<uint16_t>(~sum));
+        std::memcpy(ip + 10, &check, 2);
+
+        uint8_t* udp = ip + IP_HEADER_LEN;
+        uint16_t udp_len = htons(static_cast<uint16_t>(UDP_HEADER_LEN + payload_len));
+        std::memcpy(udp, &src_port, 2);
+        std::memcpy(udp + 2, &dst_port, 2);
+        std::memcpy(udp + 4, &udp_len, 2);
+        udp[6] = udp[7] = 0;
+    }
+};
+
+#endif // ETH_IPV4_UDP_HPP
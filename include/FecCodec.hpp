@@ -0,0 +1,180 @@
+/**
+ * @file FecCodec.hpp
+ * @brief Systematic Reed-Solomon erasure code over GF(2^8) for SPU parity fragments.
+ *
+ * Parity row j of a block of n data fragments is sum_i C[j][i] * data_i, where C is a
+ * Cauchy matrix scaled so that row 0 is all ones: one parity fragment per block is the
+ * plain XOR of the block, and any n of its n + k fragments rebuild it (MDS code).
+ * Kernels: XOR by 64-bit words, multiply-add by 4-bit split tables and PSHUFB when
+ * built with SSSE3 (a 256-entry product table per byte otherwise).
+ */
+
+#ifndef FEC_CODEC_HPP
+#define FEC_CODEC_HPP
+
+#include "spu_udp_protocol.h"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+class FecCodec {
+private:
+    struct Tables {
+        uint8_t exp[512];       // Doubled: exp[log a + log b] without a modulo
+        uint8_t log[256];
+        uint8_t mul[256][256];
+        uint8_t mul_lo[256][16];    // c * x for x < 16
+        uint8_t mul_hi[256][16];    // c * (x << 4)
+
+        Tables() {
+            unsigned x = 1;
+            for (unsigned i = 0; i < 255; ++i) {
+                exp[i] = static_cast<uint8_t>(x);
+                exp[i + 255] = static_cast<uint8_t>(x);
+                log[x] = static_cast<uint8_t>(i);
+                x <<= 1;
+                if (x & 0x100) x ^= 0x11D; // x^8 + x^4 + x^3 + x^2 + 1
+            }
+            exp[510] = exp[0];
+            exp[511] = exp[1];
+            log[0] = 0;
+            for (unsigned a = 0; a < 256; ++a)
+                for (unsigned b = 0; b < 256; ++b)
+                    mul[a][b] = (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+            for (unsigned c = 0; c < 256; ++c)
+                for (unsigned n = 0; n < 16; ++n) {
+                    mul_lo[c][n] = mul[c][n];
+                    mul_hi[c][n] = mul[c][n << 4];
+                }
+        }
+    };
+
+    static const Tables& tables() {
+        static const Tables t;
+        return t;
+    }
+
+    static void xor_into(uint8_t* dst, const uint8_t* src, size_t len) {
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8) {
+            uint64_t a, b;
+            std::memcpy(&a, dst + i, 8);
+            std::memcpy(&b, src + i, 8);
+            a ^= b;
+            std::memcpy(dst + i, &a, 8);
+        }
+        for (; i < len; ++i) dst[i] ^= src[i];
+    }
+
+public:
+    static uint8_t mul(uint8_t a, uint8_t b) { return tables().mul[a][b]; }
+
+    static uint8_t inv(uint8_t a) {
+        const Tables& t = tables();
+        return t.exp[255 - t.log[a]];
+    }
+
+    /**
+     * @brief Coefficient of data fragment 'i' in parity 'row' of a code with 'parity_count'
+     * rows: (x_0 + y_i) / (x_row + y_i) with x_j = j and y_i = parity_count + i.
+     */
+    static uint8_t coefficient(unsigned parity_count, unsigned row, unsigned i) {
+        uint8_t y = static_cast<uint8_t>(parity_count + i);
+        return mul(y, inv(static_cast<uint8_t>(row ^ y)));
+    }
+
+    /**
+     * @brief dst[0, len) += c * src[0, len) in GF(2^8).
+     */
+    static void mul_add(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len) {
+        if (c == 0) return;
+        if (c == 1) {
+            xor_into(dst, src, len);
+            return;
+        }
+        const Tables& t = tables();
+        size_t i = 0;
+#if defined(__SSSE3__)
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t.mul_lo[c]));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t.mul_hi[c]));
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        for (; i + 16 <= len; i += 16) {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+                                      _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, p));
+        }
+#endif
+        const uint8_t* row = t.mul[c];
+        for (; i < len; ++i) dst[i] ^= row[src[i]];
+    }
+
+    /**
+     * @brief Parity of a block: parity[j] (j < k, 'len' bytes each) from the n data
+     * fragments data[i] of data_lens[i] <= len bytes (zero padded).
+     */
+    static void encode(const uint8_t* const* data, const size_t* data_lens, unsigned n,
+                       uint8_t* const* parity, unsigned k, size_t len) {
+        for (unsigned j = 0; j < k; ++j) std::memset(parity[j], 0, len);
+        for (unsigned i = 0; i < n; ++i)
+            for (unsigned j = 0; j < k; ++j) mul_add(parity[j], data[i], coefficient(k, j, i), data_lens[i]);
+    }
+
+    /**
+     * @brief Rebuild the 'm' lost data fragments lost[t] of a block of 'n' from 'm' parity
+     * fragments (parity[r], row rows[r] of a code with 'k' rows, 'len' bytes) and the
+     * others (data[i] of data_lens[i] bytes, ignored for the lost ones).
+     * out[t] receives 'len' bytes.
+     * @return false if two parity rows are the same (the system has no single solution).
+     */
+    static bool decode(const uint8_t* const* data, const size_t* data_lens, unsigned n,
+                       const unsigned* lost, unsigned m, const uint8_t* const* parity,
+                       const unsigned* rows, unsigned k, uint8_t* const* out, size_t len) {
+        // Syndromes: parity minus the received fragments' share = A * lost fragments
+        std::vector<uint8_t> syndromes(static_cast<size_t>(m) * len);
+        std::vector<bool> is_lost(n, false);
+        for (unsigned t = 0; t < m; ++t) is_lost[lost[t]] = true;
+        for (unsigned r = 0; r < m; ++r) {
+            uint8_t* s = &syndromes[r * len];
+            std::memcpy(s, parity[r], len);
+            for (unsigned i = 0; i < n; ++i)
+                if (!is_lost[i]) mul_add(s, data[i], coefficient(k, rows[r], i), data_lens[i]);
+        }
+
+        // Invert A[r][t] = coefficient(rows[r], lost[t]) by Gauss-Jordan on [A | I]
+        const unsigned w = 2 * m;
+        std::vector<uint8_t> a(static_cast<size_t>(m) * w, 0);
+        for (unsigned r = 0; r < m; ++r) {
+            for (unsigned t = 0; t < m; ++t) a[r * w + t] = coefficient(k, rows[r], lost[t]);
+            a[r * w + m + r] = 1;
+        }
+        for (unsigned col = 0; col < m; ++col) {
+            unsigned pivot = col;
+            while (pivot < m && a[pivot * w + col] == 0) ++pivot;
+            if (pivot == m) return false;
+            if (pivot != col)
+                for (unsigned x = 0; x < w; ++x) std::swap(a[pivot * w + x], a[col * w + x]);
+            uint8_t scale = inv(a[col * w + col]);
+            for (unsigned x = 0; x < w; ++x) a[col * w + x] = mul(a[col * w + x], scale);
+            for (unsigned r = 0; r < m; ++r) {
+                uint8_t f = a[r * w + col];
+                if (r == col || f == 0) continue;
+                for (unsigned x = 0; x < w; ++x) a[r * w + x] ^= mul(f, a[col * w + x]);
+            }
+        }
+
+        for (unsigned t = 0; t < m; ++t) {
+            std::memset(out[t], 0, len);
+            for (unsigned r = 0; r < m; ++r) mul_add(out[t], &syndromes[r * len], a[t * w + m + r], len);
+        }
+        return true;
+    }
+};
+
+#endif // FEC_CODEC_HPP
@@ -0,0 +1,182 @@
+/**
+ * @file FixedUdpPacketizer.hpp
+ * @brief UdpPacketizer for streams whose payload size (and frame size) is known at compile time.
+ *
+ * Same packets, same wire format as UdpPacketizer with set_payload_size(PayloadSize).
+ * Fragment offsets are multiples of a constant. With a fixed FrameSize the fragment
+ * count and the tail length are constants too: headers and lengths are written once,
+ * and prepare_frame() only stores the frame ID and the payload pointers (without FEC,
+ * whose encoding pass dominates anyway).
+ */
+
+#ifndef FIXED_UDP_PACKETIZER_HPP
+#define FIXED_UDP_PACKETIZER_HPP
+
+#include "UdpPacketizer.hpp"
+#include <vector>
+#include <sys/uio.h>
+#include <stdexcept>
+
+template <size_t PayloadSize, size_t FrameSize = 0>
+class FixedUdpPacketizer {
+public:
+    typedef UdpPacketizer::Packet Packet;
+
+    static const bool FIXED_PAYLOAD = true;
+    static const size_t PAYLOAD_SIZE = PayloadSize;
+    static const size_t FRAME_SIZE = FrameSize;                 // 0: any frame size
+    static const size_t FRAGMENTS = FrameSize == 0 ? 0 : (FrameSize + PayloadSize - 1) / PayloadSize;
+    static const size_t TAIL_SIZE = FrameSize == 0 ? 0 : FrameSize - (FRAGMENTS - 1) * PayloadSize;
+
+    static_assert(PayloadSize > 0 && PayloadSize + SPU_UDP_V2_HEADER_SIZE <= SPU_UDP_MAX_DATAGRAM,
+                  "payload does not fit in a datagram");
+    static_assert(FRAGMENTS <= 0xFFFFFFFFu, "too many fragments for the protocol");
+
+private:
+    std::vector<Packet> packet_pool_;
+    size_t current_count_ = 0;
+    uint8_t version_ = SPU_UDP_VERSION_1;
+    unsigned fec_block_len_ = 0;
+    unsigned fec_parity_count_ = 0;
+    std::vector<uint8_t> parity_;
+
+    /**
+     * @brief Header and iovecs of fragment 'i' of a 'size' byte frame of 'total' fragments,
+     * but the payload address (set by prepare_frame()).
+     */
+    void fill(Packet& p, size_t i, size_t total, size_t size, uint32_t frame_id) {
+        const size_t offset = i * PayloadSize;
+        if (get_protocol_version() == SPU_UDP_VERSION_2) {
+            SpuUdpHeaderV2& h = p.header.v2;
+            h.magic = SPU_UDP_V2_MAGIC;
+            h.version = SPU_UDP_VERSION_2;
+            h.flags = 0;
+            h.header_size = static_cast<uint16_t>(SPU_UDP_V2_HEADER_SIZE);
+            h.frame_id = frame_id;
+            h.frag_index = static_cast<uint32_t>(i);
+            h.total_frags = static_cast<uint32_t>(total);
+            h.frame_size = size;
+            h.offset = offset;
+        } else {
+            p.header.v1.frame_id = frame_id;
+            p.header.v1.frag_index = static_cast<uint32_t>(i);
+            p.header.v1.total_frags = static_cast<uint32_t>(total);
+        }
+        p.iov[0].iov_base = &p.header;
+        p.iov[0].iov_len = get_header_size();
+        p.iov[1].iov_len = i + 1 < total ? PayloadSize : size - offset;
+    }
+
+    /**
+     * @brief Fixed FrameSize: lay out every packet of a frame but its ID and payload address.
+     */
+    void build() {
+        if (FrameSize == 0 || fec_parity_count_ > 0) return;
+        packet_pool_.resize(FRAGMENTS);
+        for (size_t i = 0; i < FRAGMENTS; ++i) fill(packet_pool_[i], i, FRAGMENTS, FrameSize, 0);
+    }
+
+public:
+    FixedUdpPacketizer() {
+        if (FrameSize == 0) packet_pool_.reserve(8000);
+        build();
+    }
+
+    // The iovecs point into the packets themselves
+    FixedUdpPacketizer(const FixedUdpPacketizer&) = delete;
+    FixedUdpPacketizer& operator=(const FixedUdpPacketizer&) = delete;
+
+    /**
+     * @brief See UdpPacketizer::set_protocol_version().
+     */
+    void set_protocol_version(uint8_t version) {
+        if (version != SPU_UDP_VERSION_1 && version != SPU_UDP_VERSION_2)
+            throw std::invalid_argument("FixedUdpPacketizer: unknown protocol version");
+        version_ = version;
+        build();
+    }
+
+    uint8_t get_protocol_version() const {
+        return PayloadSize == SPU_UDP_MAX_PAYLOAD && fec_parity_count_ == 0 ? version_ : SPU_UDP_VERSION_2;
+    }
+
+    /**
+     * @brief See UdpPacketizer::set_fec().
+     */
+    void set_fec(unsigned block_len, unsigned parity_count) {
+        if (parity_count > 0 && (block_len == 0 || block_len + parity_count > SPU_UDP_FEC_MAX_SHARDS))
+            throw std::invalid_argument("FixedUdpPacketizer: FEC block out of range");
+        fec_block_len_ = parity_count > 0 ? block_len : 0;
+        fec_parity_count_ = parity_count;
+        build();
+    }
+
+    unsigned get_fec_block_len() const { return fec_block_len_; }
+    unsigned get_fec_parity_count() const { return fec_parity_count_; }
+
+    /**
+     * @throws std::invalid_argument unless 'bytes' is PayloadSize: it is fixed at compile time.
+     */
+    void set_payload_size(size_t bytes) {
+        if (bytes != PayloadSize) throw std::invalid_argument("FixedUdpPacketizer: the payload size is fixed");
+    }
+
+    size_t get_payload_size() const { return PayloadSize; }
+
+    size_t get_header_size() const {
+        return get_protocol_version() == SPU_UDP_VERSION_2 ? SPU_UDP_V2_HEADER_SIZE : sizeof(SpuUdpHeader);
+    }
+
+    /**
+     * @brief See UdpPacketizer::prepare_frame().
+     * @throws std::invalid_argument if FrameSize is fixed and 'size' differs.
+     */
+    size_t prepare_frame(const void* data, size_t size, uint32_t frame_id) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+        if (FrameSize != 0 && size != FrameSize)
+            throw std::invalid_argument("FixedUdpPacketizer: frame size differs from FrameSize");
+        if (FrameSize != 0 && fec_parity_count_ == 0) {
+            Packet* packets = packet_pool_.data();
+            if (get_protocol_version() == SPU_UDP_VERSION_2) {
+                for (size_t i = 0; i < FRAGMENTS; ++i) {
+                    packets[i].header.v2.frame_id = frame_id;
+                    packets[i].iov[1].iov_base = const_cast<void*>(static_cast<const void*>(bytes + i * PayloadSize));
+                }
+            } else {
+                for (size_t i = 0; i < FRAGMENTS; ++i) {
+                    packets[i].header.v1.frame_id = frame_id;
+                    packets[i].iov[1].iov_base = const_cast<void*>(static_cast<const void*>(bytes + i * PayloadSize));
+                }
+            }
+            current_count_ = FRAGMENTS;
+            return current_count_;
+        }
+
+        size_t total_frags = (size + PayloadSize - 1) / PayloadSize;
+        if (total_frags > 0xFFFFFFFFu) throw std::runtime_error("Streampu: Frame too large for protocol limits");
+        if (total_frags == 0) total_frags = 1; // Empty frame: one packet without payload
+        const bool fec = fec_parity_count_ > 0 && size > 0;
+        const size_t packet_count =
+            fec ? UdpPacketizer::fec_packet_count(total_frags, fec_block_len_, fec_parity_count_) : total_frags;
+        if (packet_count > packet_pool_.size()) packet_pool_.resize(packet_count);
+
+        size_t pos = 0;
+        for (size_t i = 0; i < total_frags; ++i) {
+            Packet& p = packet_pool_[pos++];
+            fill(p, i, total_frags, size, frame_id);
+            p.iov[1].iov_base = const_cast<void*>(static_cast<const void*>(bytes + i * PayloadSize));
+            if (fec && ((i + 1) % fec_block_len_ == 0 || i + 1 == total_frags)) pos += fec_parity_count_;
+        }
+        if (fec) UdpPacketizer::add_parity(packet_pool_.data(), total_frags, size, frame_id, fec_block_len_,
+                                           fec_parity_count_, PayloadSize, parity_);
+        current_count_ = packet_count;
+        return current_count_;
+    }
+
+    const Packet* get_packets() const { return packet_pool_.data(); }
+
+    size_t get_count() const { return current_count_; }
+};
+
+#endif // FIXED_UDP_PACKETIZER_HPP
@@ -0,0 +1,153 @@
+/**
+ * @file FragmentBitmap.hpp
+ * @brief Received-fragment bitmap packed in 64-bit words.
+ *
+ * Frames of up to INLINE_BITS fragments use the words stored inside the object
+ * (no allocation, same cache lines as the frame slot). Larger frames spill to a
+ * heap array whose capacity is kept when the bitmap is reused, up to KEEP_WORDS
+ * (see trim()).
+ */
+
+#ifndef FRAGMENT_BITMAP_HPP
+#define FRAGMENT_BITMAP_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/**
+ * @brief Run of consecutive fragments [first, first + count).
+ */
+struct FragmentRange {
+    uint32_t first;
+    uint32_t count;
+};
+
+class FragmentBitmap {
+public:
+    static const size_t INLINE_WORDS = 16;
+    static const size_t INLINE_BITS = INLINE_WORDS * 64;
+    static const size_t KEEP_WORDS = 1024;      // 64K fragments: 8 KB kept for the next frame
+
+private:
+    uint64_t inline_words_[INLINE_WORDS];
+    std::vector<uint64_t> heap_words_;
+    uint64_t* words_ = inline_words_;
+    size_t bits_ = 0;
+    size_t n_words_ = 0;
+
+    /**
+     * @brief First index >= 'pos' whose bit equals 'value' (size() if none).
+     * Whole words that cannot match are skipped with a single compare.
+     */
+    size_t find_next(size_t pos, bool value) const {
+        if (pos >= bits_) return bits_;
+        size_t w = pos >> 6;
+        uint64_t word = (value ? words_[w] : ~words_[w]) & (~0ULL << (pos & 63));
+        while (word == 0) {
+            if (++w >= n_words_) return bits_;
+            word = value ? words_[w] : ~words_[w];
+        }
+        size_t found = (w << 6) + static_cast<size_t>(__builtin_ctzll(word));
+        return found < bits_ ? found : bits_;
+    }
+
+public:
+    FragmentBitmap() { std::memset(inline_words_, 0, sizeof(inline_words_)); }
+
+    // Copying would leave words_ pointing into the source object
+    FragmentBitmap(const FragmentBitmap& other) { *this = other; }
+
+    FragmentBitmap& operator=(const FragmentBitmap& other) {
+        if (this == &other) return *this;
+        std::memcpy(inline_words_, other.inline_words_, sizeof(inline_words_));
+        heap_words_ = other.heap_words_;
+        words_ = (other.words_ == other.inline_words_) ? inline_words_ : heap_words_.data();
+        bits_ = other.bits_;
+        n_words_ = other.n_words_;
+        return *this;
+    }
+
+    /**
+     * @brief Resize to 'bits' fragments, all cleared.
+     * @throws std::bad_alloc if a large bitmap cannot be allocated.
+     */
+    void reset(size_t bits) {
+        size_t n_words = (bits + 63) / 64;
+        if (n_words <= INLINE_WORDS) {
+            words_ = inline_words_;
+        } else {
+            if (heap_words_.size() < n_words) heap_words_.resize(n_words);
+            words_ = heap_words_.data();
+        }
+        std::memset(words_, 0, n_words * sizeof(uint64_t));
+        bits_ = bits;
+        n_words_ = n_words;
+    }
+
+    /**
+     * @brief Heap bytes reset('bits') needs (0 when the bits fit inline).
+     */
+    static size_t heap_bytes(size_t bits) {
+        size_t n_words = (bits + 63) / 64;
+        return n_words <= INLINE_WORDS ? 0 : n_words * sizeof(uint64_t);
+    }
+
+    /**
+     * @brief Give a heap array larger than KEEP_WORDS back (the bitmap is then empty).
+     * Call once its frame is over, so that one huge frame does not pin its bitmap.
+     */
+    void trim() {
+        if (heap_words_.capacity() <= KEEP_WORDS) return;
+        std::vector<uint64_t>().swap(heap_words_);
+        words_ = inline_words_;
+        bits_ = 0;
+        n_words_ = 0;
+    }
+
+    size_t size() const { return bits_; }
+
+    bool test(size_t i) const { return (words_[i >> 6] >> (i & 63)) & 1; }
+
+    /**
+     * @brief Set bit 'i'. @return false if it was already set.
+     */
+    bool set(size_t i) {
+        uint64_t bit = 1ULL << (i & 63);
+        uint64_t& word = words_[i >> 6];
+        if (word & bit) return false;
+        word |= bit;
+        return true;
+    }
+
+    /**
+     * @brief Number of bits set (popcount over the words).
+     */
+    size_t count() const {
+        size_t total = 0;
+        for (size_t w = 0; w < n_words_; ++w) total += static_cast<size_t>(__builtin_popcountll(words_[w]));
+        return total;
+    }
+
+    bool all() const { return find_next(0, false) == bits_; }
+
+    /**
+     * @brief Write up to 'max_ranges' runs of cleared bits to 'out'.
+     * @return Number of ranges written.
+     */
+    size_t missing_ranges(FragmentRange* out, size_t max_ranges) const {
+        size_t n = 0;
+        size_t first = find_next(0, false);
+        while (first < bits_ && n < max_ranges) {
+            size_t end = find_next(first, true);
+            out[n].first = static_cast<uint32_t>(first);
+            out[n].count = static_cast<uint32_t>(end - first);
+            ++n;
+            first = find_next(end, false);
+        }
+        return n;
+    }
+};
+
+#endif // FRAGMENT_BITMAP_HPP
@@ -0,0 +1,248 @@
+/**
+ * @file FrameBufferPool.hpp
+ * @brief Size-classed pool of recycled frame buffers for the UDP receive path.
+ *
+ * Buffers are handed out uninitialized (no memset) and return to the pool when
+ * the FrameBuffer handle holding them is destroyed, so steady-state reception
+ * performs no heap allocation.
+ *
+ * Very large frames can instead use a reserved mapping (FrameBuffer::reserve())
+ * whose memory is committed piece by piece as data lands in it.
+ */
+
+#ifndef FRAME_BUFFER_POOL_HPP
+#define FRAME_BUFFER_POOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+
+class FrameBufferPool;
+
+/**
+ * @brief Move-only handle on a pooled buffer (vector-like read API).
+ */
+class FrameBuffer {
+private:
+    std::shared_ptr<FrameBufferPool> pool_;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+    bool mapped_ = false;       // Reserved mapping (see reserve()), unmapped on reset()
+
+public:
+    FrameBuffer() = default;
+
+    FrameBuffer(std::shared_ptr<FrameBufferPool> pool, uint8_t* data, size_t size, size_t capacity)
+    : pool_(std::move(pool)), data_(data), size_(size), capacity_(capacity) {}
+
+    ~FrameBuffer() { reset(); }
+
+    FrameBuffer(FrameBuffer&& other) noexcept { swap(other); }
+
+    FrameBuffer& operator=(FrameBuffer&& other) noexcept {
+        if (this != &other) {
+            reset();
+            swap(other);
+        }
+        return *this;
+    }
+
+    FrameBuffer(const FrameBuffer&) = delete;
+    FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+    uint8_t* data() { return data_; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    uint8_t& operator[](size_t i) { return data_[i]; }
+    const uint8_t& operator[](size_t i) const { return data_[i]; }
+
+    uint8_t* begin() { return data_; }
+    uint8_t* end() { return data_ + size_; }
+    const uint8_t* begin() const { return data_; }
+    const uint8_t* end() const { return data_ + size_; }
+
+    /**
+     * @brief Change the logical size (never reallocates, new bytes are not initialized).
+     */
+    void resize(size_t size) {
+        if (size > capacity_) throw std::bad_alloc();
+        size_ = size;
+    }
+
+    /**
+     * @brief Reserve address space for 'size' bytes without backing memory (PROT_NONE).
+     * Ranges must be commit()ed before they are accessed.
+     * @throws std::bad_alloc if the address space cannot be reserved.
+     */
+    static FrameBuffer reserve(size_t size) {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t length = (size + page - 1) / page * page;
+        void* ptr = mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (ptr == MAP_FAILED) throw std::bad_alloc();
+
+        FrameBuffer buffer;
+        buffer.data_ = static_cast<uint8_t*>(ptr);
+        buffer.size_ = size;
+        buffer.capacity_ = length;
+        buffer.mapped_ = true;
+        return buffer;
+    }
+
+    bool is_mapped() const { return mapped_; }
+
+    /**
+     * @brief Reserved mapping: make [offset, offset + len) usable ('offset' page aligned).
+     * Pages are only backed by memory once written.
+     */
+    bool commit(size_t offset, size_t len) {
+        return mprotect(data_ + offset, len, PROT_READ | PROT_WRITE) == 0;
+    }
+
+    /**
+     * @brief Reserved mapping: give back the whole pages past size().
+     */
+    void shrink_to_fit() {
+        if (!mapped_) return;
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t keep = (size_ + page - 1) / page * page;
+        if (keep == 0) keep = page;
+        if (keep < capacity_ && munmap(data_ + keep, capacity_ - keep) == 0) capacity_ = keep;
+    }
+
+    /**
+     * @brief Give the buffer back to its pool (or free it).
+     */
+    inline void reset();
+
+    void swap(FrameBuffer& other) noexcept {
+        std::swap(pool_, other.pool_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(mapped_, other.mapped_);
+    }
+};
+
+class FrameBufferPool : public std::enable_shared_from_this<FrameBufferPool> {
+private:
+    // Class sizes are quarter steps between powers of two (at most 25% waste)
+    static const size_t MIN_CLASS_SIZE = 4096;
+
+    std::map<size_t, std::vector<uint8_t*>> free_lists_;
+    std::mutex mutex_;
+    size_t max_free_per_class_;
+
+    // Statistics
+    size_t allocations_ = 0;
+    size_t recycled_ = 0;
+
+public:
+    explicit FrameBufferPool(size_t max_free_per_class = 8)
+    : max_free_per_class_(max_free_per_class) {}
+
+    ~FrameBufferPool() {
+        for (auto& entry : free_lists_)
+            for (uint8_t* ptr : entry.second) delete[] ptr;
+    }
+
+    FrameBufferPool(const FrameBufferPool&) = delete;
+    FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+    /**
+     * @brief Round a request up to its size class.
+     */
+    static size_t class_size(size_t size) {
+        if (size <= MIN_CLASS_SIZE) return MIN_CLASS_SIZE;
+        size_t top = 1;
+        while ((top << 1) < size) top <<= 1; // top < size <= 2 * top
+        size_t step = top / 4;
+        return ((size + step - 1) / step) * step;
+    }
+
+    /**
+     * @brief Get an uninitialized buffer of at least 'size' bytes.
+     * @throws std::bad_alloc if a new buffer cannot be allocated.
+     */
+    FrameBuffer acquire(size_t size) {
+        size_t cls = class_size(size);
+        uint8_t* ptr = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = free_lists_.find(cls);
+            if (it != free_lists_.end() && !it->second.empty()) {
+                ptr = it->second.back();
+                it->second.pop_back();
+                recycled_++;
+            } else {
+                allocations_++;
+            }
+        }
+        if (ptr == nullptr) ptr = new uint8_t[cls]; // Uninitialized on purpose
+        return FrameBuffer(shared_from_this(), ptr, size, cls);
+    }
+
+    /**
+     * @brief Pre-populate the pool so the first frames do not allocate either.
+     */
+    void preallocate(size_t size, size_t count) {
+        size_t cls = class_size(size);
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<uint8_t*>& list = free_lists_[cls];
+        while (list.size() < count) {
+            list.push_back(new uint8_t[cls]);
+            allocations_++;
+        }
+        if (max_free_per_class_ < count) max_free_per_class_ = count;
+    }
+
+    /**
+     * @brief Return a buffer (called by FrameBuffer::reset()).
+     */
+    void recycle(uint8_t* ptr, size_t capacity) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<uint8_t*>& list = free_lists_[capacity];
+            if (list.size() < max_free_per_class_) {
+                list.push_back(ptr);
+                return;
+            }
+        }
+        delete[] ptr;
+    }
+
+    size_t get_allocations() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return allocations_;
+    }
+
+    size_t get_recycled() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return recycled_;
+    }
+};
+
+inline void FrameBuffer::reset() {
+    if (data_ != nullptr) {
+        if (mapped_) munmap(data_, capacity_);
+        else if (pool_) pool_->recycle(data_, capacity_);
+        else delete[] data_;
+    }
+    pool_.reset();
+    data_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+    mapped_ = false;
+}
+
+#endif // FRAME_BUFFER_POOL_HPP
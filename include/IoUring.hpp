@@ -0,0 +1,284 @@
+/**
+ * @file IoUring.hpp
+ * @brief Minimal RAII wrapper around the raw io_uring syscalls (no liburing dependency).
+ *
+ * Only what the UDP backends need: SQE/CQE ring access, submit/wait with a timeout,
+ * registered buffers and provided-buffer rings (IORING_REGISTER_PBUF_RING).
+ */
+
+#ifndef IO_URING_HPP
+#define IO_URING_HPP
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class IoUring {
+private:
+    int ring_fd_ = -1;
+    struct io_uring_params params_;
+
+    // Submission queue
+    void* sq_ptr_ = MAP_FAILED;
+    size_t sq_map_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    struct io_uring_sqe* sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_map_size_ = 0;
+    unsigned sqe_tail_ = 0;     // Local tail: SQEs handed out but not published yet
+
+    // Completion queue
+    void* cq_ptr_ = MAP_FAILED;
+    size_t cq_map_size_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+
+public:
+    /**
+     * @param entries Submission queue size.
+     * @param cq_entries Completion queue size (0: kernel default, twice 'entries').
+     *        Multishot requests post many CQEs per SQE and want a deeper CQ.
+     * @throws std::runtime_error if io_uring is unavailable (old kernel, seccomp, sysctl).
+     */
+    explicit IoUring(unsigned entries, unsigned cq_entries = 0, unsigned flags = 0) {
+        std::memset(&params_, 0, sizeof(params_));
+        params_.flags = flags;
+        if (cq_entries > 0) {
+            params_.flags |= IORING_SETUP_CQSIZE;
+            params_.cq_entries = cq_entries;
+        }
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params_));
+        if (ring_fd_ < 0) {
+            throw std::runtime_error("IoUring: io_uring_setup failed (" + std::string(std::strerror(errno)) + ")");
+        }
+
+        sq_map_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+        cq_map_size_ = params_.cq_off.cqes + params_.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = (params_.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            if (cq_map_size_ > sq_map_size_) sq_map_size_ = cq_map_size_;
+            cq_map_size_ = sq_map_size_;
+        }
+
+        sq_ptr_ = mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) { release(); throw std::runtime_error("IoUring: cannot map the SQ ring"); }
+
+        if (single_mmap) {
+            cq_ptr_ = sq_ptr_;
+        } else {
+            cq_ptr_ = mmap(nullptr, cq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED) { release(); throw std::runtime_error("IoUring: cannot map the CQ ring"); }
+        }
+
+        sqes_map_size_ = params_.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ = static_cast<struct io_uring_sqe*>(
+            mmap(nullptr, sqes_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+        if (sqes_ == MAP_FAILED) { release(); throw std::runtime_error("IoUring: cannot map the SQEs"); }
+
+        uint8_t* sq = static_cast<uint8_t*>(sq_ptr_);
+        sq_head_  = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+        sq_tail_  = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+        sq_mask_  = *reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+        sqe_tail_ = *sq_tail_;
+
+        uint8_t* cq = static_cast<uint8_t*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+        cqes_    = reinterpret_cast<struct io_uring_cqe*>(cq + params_.cq_off.cqes);
+    }
+
+    ~IoUring() { release(); }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    int get_fd() const { return ring_fd_; }
+    unsigned get_features() const { return params_.features; }
+
+    /**
+     * @brief Next free SQE (zeroed), or nullptr if the submission queue is full.
+     */
+    struct io_uring_sqe* get_sqe() {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sqe_tail_ - head > sq_mask_) return nullptr;
+        struct io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+        sq_array_[sqe_tail_ & sq_mask_] = sqe_tail_ & sq_mask_;
+        sqe_tail_++;
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    /**
+     * @brief Publish the prepared SQEs and optionally wait for completions.
+     * @param wait_nr Minimum number of CQEs to wait for (0: do not wait).
+     * @param timeout_ms Upper bound on the wait (-1: none). Requires IORING_FEAT_EXT_ARG.
+     * @return Number of SQEs consumed, or -errno (-ETIME on timeout).
+     */
+    int submit(unsigned wait_nr = 0, int timeout_ms = -1) {
+        unsigned tail = *sq_tail_;
+        unsigned to_submit = sqe_tail_ - tail;
+        __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+        if (to_submit == 0 && wait_nr == 0) return 0;
+
+        unsigned enter_flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        void* argp = nullptr;
+        size_t argsz = 0;
+        if (wait_nr > 0 && timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+            std::memset(&arg, 0, sizeof(arg));
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            argp = &arg;
+            argsz = sizeof(arg);
+            enter_flags |= IORING_ENTER_EXT_ARG;
+        }
+
+        int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr, enter_flags, argp, argsz));
+        return ret < 0 ? -errno : ret;
+    }
+
+    /**
+     * @brief Oldest unseen CQE, or nullptr (never enters the kernel).
+     */
+    struct io_uring_cqe* peek_cqe() {
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) return nullptr;
+        return &cqes_[head & cq_mask_];
+    }
+
+    /**
+     * @brief Mark 'count' CQEs as consumed.
+     */
+    void cq_advance(unsigned count = 1) {
+        __atomic_store_n(cq_head_, *cq_head_ + count, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * @brief Register fixed buffers (IORING_OP_*_FIXED, SEND_ZC with buf_index).
+     * @return 0 or -errno.
+     */
+    int register_buffers(const struct iovec* iovs, unsigned count) {
+        int ret = static_cast<int>(syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, iovs, count));
+        return ret < 0 ? -errno : ret;
+    }
+
+    int register_pbuf_ring(struct io_uring_buf_reg* reg) {
+        int ret = static_cast<int>(syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, reg, 1));
+        return ret < 0 ? -errno : ret;
+    }
+
+    /**
+     * @brief Whether the running kernel implements 'opcode' (IORING_REGISTER_PROBE).
+     */
+    bool probe_opcode(unsigned opcode) {
+        const unsigned nr_ops = 256;
+        std::vector<uint8_t> mem(sizeof(struct io_uring_probe) + nr_ops * sizeof(struct io_uring_probe_op), 0);
+        struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(mem.data());
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, nr_ops) < 0) return false;
+        if (opcode > probe->last_op) return false;
+        return (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+
+private:
+    void release() {
+        if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_map_size_);
+        if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_map_size_);
+        if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_map_size_);
+        if (ring_fd_ >= 0) close(ring_fd_);
+        sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+        cq_ptr_ = sq_ptr_ = MAP_FAILED;
+        ring_fd_ = -1;
+    }
+};
+
+/**
+ * @brief Provided-buffer ring: the kernel picks a buffer for each completion
+ * (IOSQE_BUFFER_SELECT) and the application hands buffers back after use.
+ */
+class IoUringBufRing {
+private:
+    IoUring& ring_;
+    void* mem_ = MAP_FAILED;
+    size_t mem_size_ = 0;
+    unsigned entries_;
+    uint16_t bgid_;
+    uint16_t local_tail_ = 0;   // Buffers added but not published yet
+
+    // io_uring_buf entries; the ring tail overlays the 'resv' field of entry 0
+    struct io_uring_buf* bufs() { return static_cast<struct io_uring_buf*>(mem_); }
+    uint16_t* shared_tail() { return reinterpret_cast<uint16_t*>(static_cast<uint8_t*>(mem_) + 14); }
+
+public:
+    /**
+     * @param entries Number of buffers (power of two, <= 32768).
+     * @throws std::runtime_error if the kernel cannot register it (Linux < 5.19).
+     */
+    IoUringBufRing(IoUring& ring, unsigned entries, uint16_t bgid)
+    : ring_(ring), entries_(entries), bgid_(bgid) {
+        mem_size_ = entries * sizeof(struct io_uring_buf);
+        mem_ = mmap(nullptr, mem_size_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (mem_ == MAP_FAILED) throw std::runtime_error("IoUringBufRing: cannot allocate the ring");
+
+        struct io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(mem_);
+        reg.ring_entries = entries;
+        reg.bgid = bgid;
+        int ret = ring_.register_pbuf_ring(&reg);
+        if (ret < 0) {
+            munmap(mem_, mem_size_);
+            mem_ = MAP_FAILED;
+            throw std::runtime_error("IoUringBufRing: IORING_REGISTER_PBUF_RING failed (" +
+                                     std::string(std::strerror(-ret)) + ")");
+        }
+    }
+
+    ~IoUringBufRing() {
+        if (mem_ == MAP_FAILED) return;
+        struct io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.bgid = bgid_;
+        syscall(__NR_io_uring_register, ring_.get_fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(mem_, mem_size_);
+    }
+
+    IoUringBufRing(const IoUringBufRing&) = delete;
+    IoUringBufRing& operator=(const IoUringBufRing&) = delete;
+
+    uint16_t get_bgid() const { return bgid_; }
+
+    /**
+     * @brief Queue a buffer for the kernel (visible after publish()).
+     */
+    void add(void* addr, uint32_t len, uint16_t bid) {
+        struct io_uring_buf* buf = &bufs()[local_tail_ & (entries_ - 1)];
+        buf->addr = reinterpret_cast<uint64_t>(addr);
+        buf->len = len;
+        buf->bid = bid;
+        local_tail_++;
+    }
+
+    void publish() {
+        __atomic_store_n(shared_tail(), local_tail_, __ATOMIC_RELEASE);
+    }
+};
+
+#endif // IO_URING_HPP
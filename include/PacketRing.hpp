@@ -0,0 +1,200 @@
+/**
+ * @file PacketRing.hpp
+ * @brief AF_PACKET TPACKET_V3 receive ring (memory-mapped, no per-packet syscall).
+ *
+ * The kernel fills fixed-size blocks of packets and hands a whole block over at
+ * once (when it is full or after a short retire timeout). A classic BPF filter
+ * keeps only IPv4/UDP packets for the SPU port. With several rings a
+ * PACKET_FANOUT_CBPF group spreads packets by SPU frame_id.
+ */
+
+#ifndef PACKET_RING_HPP
+#define PACKET_RING_HPP
+
+#include "spu_udp_protocol.h"
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+
+class PacketRing {
+private:
+    int fd_ = -1;
+    uint8_t* ring_ = static_cast<uint8_t*>(MAP_FAILED);
+    size_t ring_size_ = 0;
+    uint32_t block_size_;
+    uint32_t block_count_;
+    uint32_t current_ = 0;      // Next block to read
+
+    void release() {
+        if (ring_ != MAP_FAILED) munmap(ring_, ring_size_);
+        if (fd_ >= 0) close(fd_);
+        ring_ = static_cast<uint8_t*>(MAP_FAILED);
+        fd_ = -1;
+    }
+
+    [[noreturn]] void fail(const std::string& what) {
+        std::string msg = "PacketRing: " + what + " (" + std::strerror(errno) + ")";
+        release();
+        throw std::runtime_error(msg);
+    }
+
+    struct tpacket_block_desc* block(uint32_t index) {
+        return reinterpret_cast<struct tpacket_block_desc*>(ring_ + static_cast<size_t>(index) * block_size_);
+    }
+
+    /**
+     * @brief Accept Ethernet/IPv4/UDP packets (not fragmented) for 'port', whole packet.
+     * The socket filter sees the frame from its Ethernet header.
+     */
+    void attach_port_filter(uint16_t port) {
+        struct sock_filter code[] = {
+            BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 12),                      // EtherType
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   ETH_P_IP, 0, 8),
+            BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 23),                      // IP protocol
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   IPPROTO_UDP, 0, 6),
+            BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 20),                      // MF + fragment offset
+            BPF_JUMP(BPF_JMP | BPF_JSET| BPF_K,   0x3fff, 4, 0),
+            BPF_STMT(BPF_LDX | BPF_B   | BPF_MSH, 14),                      // X = IP header length
+            BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 16),                      // UDP destination port
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   port, 0, 1),
+            BPF_STMT(BPF_RET | BPF_K,             0x40000),
+            BPF_STMT(BPF_RET | BPF_K,             0),
+        };
+        struct sock_fprog prog;
+        prog.len = sizeof(code) / sizeof(code[0]);
+        prog.filter = code;
+        if (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+            fail("cannot attach the port filter");
+    }
+
+public:
+    /**
+     * @param ifname Interface to capture on (e.g. "lo").
+     * @param udp_port Destination port of the SPU traffic.
+     * @param block_size Ring block size (multiple of the page size).
+     * @param block_count Number of blocks.
+     * @param retire_ms A partially filled block is handed over after this delay.
+     * @throws std::runtime_error (unknown interface, no CAP_NET_RAW, ...).
+     */
+    PacketRing(const std::string& ifname, uint16_t udp_port, uint32_t block_size = 1u << 21,
+               uint32_t block_count = 16, uint32_t retire_ms = 2)
+    : block_size_(block_size), block_count_(block_count) {
+        unsigned ifindex = if_nametoindex(ifname.c_str());
+        if (ifindex == 0) throw std::runtime_error("PacketRing: unknown interface " + ifname);
+
+        // Protocol 0: nothing is captured until bind(), i.e. until the filter and ring are ready
+        fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+        if (fd_ < 0) fail("cannot create the AF_PACKET socket");
+
+        int version = TPACKET_V3;
+        if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+            fail("TPACKET_V3 not supported");
+        attach_port_filter(udp_port);
+
+        struct tpacket_req3 req;
+        std::memset(&req, 0, sizeof(req));
+        req.tp_block_size = block_size;
+        req.tp_block_nr = block_count;
+        req.tp_frame_size = 2048;   // Only used for sanity checks by V3 (packets are packed)
+        req.tp_frame_nr = (block_size / req.tp_frame_size) * block_count;
+        req.tp_retire_blk_tov = retire_ms;
+        if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) fail("cannot create the ring");
+
+        ring_size_ = static_cast<size_t>(block_size) * block_count;
+        ring_ = static_cast<uint8_t*>(mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0));
+        if (ring_ == MAP_FAILED) fail("cannot map the ring");
+
+        // ETH_P_IP (not ETH_P_ALL): only received packets, not the outgoing copies
+        struct sockaddr_ll sll;
+        std::memset(&sll, 0, sizeof(sll));
+        sll.sll_family = AF_PACKET;
+        sll.sll_protocol = htons(ETH_P_IP);
+        sll.sll_ifindex = static_cast<int>(ifindex);
+        if (bind(fd_, reinterpret_cast<struct sockaddr*>(&sll), sizeof(sll)) < 0) fail("cannot bind to " + ifname);
+    }
+
+    ~PacketRing() { release(); }
+
+    PacketRing(const PacketRing&) = delete;
+    PacketRing& operator=(const PacketRing&) = delete;
+
+    int get_fd() const { return fd_; }
+
+    /**
+     * @brief Join a fanout group whose members each get frame_id % n_members.
+     * Every member must join with the same 'group_id' and 'n_members'.
+     * @return false if the kernel refuses (no PACKET_FANOUT_CBPF: Linux < 4.2).
+     */
+    bool join_fanout(uint16_t group_id, uint32_t n_members) {
+        int arg = group_id | (PACKET_FANOUT_CBPF << 16);
+        if (setsockopt(fd_, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0) return false;
+
+        // The fanout program sees the packet from its IP header: the SPU header is past the UDP one
+        struct sock_filter code[SPU_UDP_STEERING_LEN];
+        spu_udp_steering_program(code, 8, true, n_members);
+        struct sock_fprog prog;
+        prog.len = sizeof(code) / sizeof(code[0]);
+        prog.filter = code;
+        return setsockopt(fd_, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof(prog)) == 0;
+    }
+
+    /**
+     * @brief Wait until the next block is handed over (or timeout). @return true if ready.
+     */
+    bool wait(int timeout_ms) {
+        if (__atomic_load_n(&block(current_)->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) return true;
+        struct pollfd pfd = {fd_, POLLIN | POLLERR, 0};
+        return poll(&pfd, 1, timeout_ms) > 0;
+    }
+
+    /**
+     * @brief Hand every packet of up to 'max_blocks' ready blocks to on_packet(frame, len),
+     * 'frame' starting at the Ethernet header; each block is returned to the kernel after use.
+     * @return Number of packets processed (0: no block ready).
+     */
+    template <typename Callback>
+    unsigned receive(unsigned max_blocks, Callback on_packet) {
+        unsigned packets = 0;
+        for (unsigned b = 0; b < max_blocks; ++b) {
+            struct tpacket_block_desc* desc = block(current_);
+            if ((__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) break;
+
+            uint32_t count = desc->hdr.bh1.num_pkts;
+            uint8_t* pos = reinterpret_cast<uint8_t*>(desc) + desc->hdr.bh1.offset_to_first_pkt;
+            for (uint32_t i = 0; i < count; ++i) {
+                struct tpacket3_hdr* pkt = reinterpret_cast<struct tpacket3_hdr*>(pos);
+                on_packet(static_cast<const uint8_t*>(pos + pkt->tp_mac), static_cast<size_t>(pkt->tp_snaplen));
+                pos += pkt->tp_next_offset;
+            }
+            packets += count;
+
+            __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+            current_ = (current_ + 1) % block_count_;
+        }
+        return packets;
+    }
+
+    /**
+     * @brief Packets dropped by the kernel because the ring was full (resets the counter).
+     */
+    unsigned get_drops() {
+        struct tpacket_stats_v3 stats;
+        socklen_t len = sizeof(stats);
+        if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0) return 0;
+        return stats.tp_drops;
+    }
+};
+
+#endif // PACKET_RING_HPP
@@ -18,11 +18,15 @@ namespace spu
 namespace module
 {
 
-template <typename B = uint8_t>
+/**
+ * @tparam SinkImpl UdpSink, or e.g. FixedUdpSink<8192, 1 << 20> when the payload size and
+ *         the frame size (max_data_size * sizeof(B) bytes) are known at compile time.
+ */
+template <typename B = uint8_t, class SinkImpl = UdpSink>
 class Sink_UDP : public Sink<B>
 {
 protected:
-    UdpSink udp_sink_;
+    SinkImpl udp_sink_;
 
 public:
     Sink_UDP(const int max_data_size, const std::string& ip, const int port)
@@ -36,7 +40,96 @@ public:
 
     virtual ~Sink_UDP() = default;
 
-    virtual Sink_UDP<B>* clone() const
+    /**
+     * @brief Select the transmit path (e.g. UdpSink::TxMode::GSO).
+     * With UdpSink::TxMode::IO_URING, _send() returns as soon as the fragments are
+     * staged and submitted: the StreamPU buffer can be reused right away.
+     */
+    void set_tx_mode(UdpSink::TxMode mode)
+    {
+        udp_sink_.set_tx_mode(mode);
+    }
+
+    /**
+     * @brief AF_XDP transmission setup, see UdpSink::set_xdp_interface().
+     * Call before set_tx_mode(UdpSink::TxMode::XDP).
+     */
+    bool set_xdp_interface(const std::string& ifname, const std::string& dst_mac, const std::string& src_ip = "")
+    {
+        return udp_sink_.set_xdp_interface(ifname, dst_mac, src_ip);
+    }
+
+    /**
+     * @brief Send with MSG_ZEROCOPY. Each _send() then returns once the kernel has
+     * released the StreamPU buffer, since the upstream task rewrites it for the next frame.
+     */
+    void set_zerocopy(bool enable)
+    {
+        udp_sink_.set_zerocopy(enable);
+    }
+
+    /**
+     * @brief Fragment header version, see UdpSink::set_protocol_version().
+     */
+    void set_protocol_version(uint8_t version)
+    {
+        udp_sink_.set_protocol_version(version);
+    }
+
+    /**
+     * @brief Parity fragments per block of data fragments, see UdpSink::set_fec().
+     */
+    void set_fec(unsigned block_len, unsigned parity_count)
+    {
+        udp_sink_.set_fec(block_len, parity_count);
+    }
+
+    /**
+     * @brief Resend the fragments the receiver reports missing, from copies of the
+     * last 'frames' frames, see UdpSink::set_retransmission().
+     */
+    void set_retransmission(size_t frames, uint16_t feedback_port)
+    {
+        udp_sink_.set_retransmission(frames, feedback_port);
+    }
+
+    /**
+     * @brief Only send the frames the receiver grants credit for, see UdpSink::set_flow_control().
+     * With the BLOCK policy, _send() waits for credit and stalls the pipeline upstream.
+     */
+    void set_flow_control(uint16_t feedback_port, UdpSink::CreditPolicy policy = UdpSink::CreditPolicy::BLOCK,
+                          int timeout_ms = 1000)
+    {
+        udp_sink_.set_flow_control(feedback_port, policy, timeout_ms);
+    }
+
+    /**
+     * @brief Send at 'bits_per_second' instead of in one burst per frame, see UdpSink::set_pacing().
+     */
+    void set_pacing(uint64_t bits_per_second, UdpSink::PacingMode mode = UdpSink::PacingMode::AUTO,
+                    size_t burst_bytes = 0)
+    {
+        udp_sink_.set_pacing(bits_per_second, mode, burst_bytes);
+    }
+
+    /**
+     * @brief Spread each frame over 'interval_us', see UdpSink::set_frame_pacing().
+     */
+    void set_frame_pacing(unsigned interval_us, UdpSink::PacingMode mode = UdpSink::PacingMode::AUTO,
+                          size_t burst_bytes = 0)
+    {
+        udp_sink_.set_frame_pacing(interval_us, mode, burst_bytes);
+    }
+
+    /**
+     * @brief Payload bytes per fragment, 0 for the path MTU (default), see UdpSink::set_payload_size().
+     */
+    void set_payload_size(size_t bytes)
+    {
+        udp_sink_.set_payload_size(bytes);
+    }
+
+    virtual Sink_UDP<B, SinkImpl>* clone() const
     {
         // Cloning is strictly forbidden for this class.
         std::cerr << "Fatal: cloning Sink_UDP is not allowed." << std::endl;
@@ -47,7 +140,11 @@ protected:
     void _send(const B *in_data, const size_t frame_id) override
     {
         // Directly send the buffer provided by StreamPU
-        udp_sink_.send_frame(in_data, this->max_data_size);
+        udp_sink_.send_frame(in_data, this->max_data_size * sizeof(B));
+
+        // Zero-Copy Mode: in_data must stay untouched until the kernel is done with it
+        if (udp_sink_.get_zerocopy())
+            udp_sink_.wait_released(in_data);
     }
 };
 
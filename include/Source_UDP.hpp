@@ -7,6 +7,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <string>
 #include <iostream>
 #include <streampu.hpp>
 
@@ -18,19 +19,36 @@ namespace spu
 namespace module
 {
 
-template <typename B = uint8_t>
+/**
+ * @tparam SourceImpl UdpSource, or e.g. FixedUdpSource<8192, 1 << 20> when the payload size and
+ *         the frame size (max_data_size * sizeof(B) bytes) are known at compile time.
+ */
+template <typename B = uint8_t, class SourceImpl = UdpSource>
 class Source_UDP : public Source<B>
 {
 protected:
-    UdpSource udp_source_;
+    SourceImpl udp_source_;
     int timeout_ms_;
+    bool direct_mode_;
 
 public:
-    Source_UDP(const int max_data_size, const int port, int timeout_ms = 1000)
+    /**
+     * @param direct_mode If true, frames are reassembled directly into the StreamPU
+     *                    output buffer (no intermediate full-frame copy). With several
+     *                    threads and no frame_id steering (kernel hashing, XDP), only the
+     *                    frames of the shard the stream lands on are: other shards' frames are copied.
+     * @param n_threads   Number of receive threads (SO_REUSEPORT shards, frames are spread by frame_id).
+     */
+    Source_UDP(const int max_data_size, const int port, int timeout_ms = 1000, bool direct_mode = true,
+               unsigned n_threads = 1)
     : Source<B>(max_data_size),
-      udp_source_(port),
-      timeout_ms_(timeout_ms)
+      udp_source_(port, 64, n_threads),
+      timeout_ms_(timeout_ms),
+      direct_mode_(direct_mode)
     {
+        // Warm up the reassembly pool (used when frames are queued instead of direct)
+        udp_source_.preallocate_frames(max_data_size * sizeof(B), 4);
+
         const std::string name = "Source_UDP";
         this->set_name(name);
         this->set_short_name(name);
@@ -44,7 +62,30 @@ public:
         udp_source_.stop();
     }
 
-    virtual Source_UDP<B>* clone() const
+    /**
+     * @brief Ask the sender to resend missing fragments, see UdpSource::set_nack().
+     * The receive threads are already running: this restarts them.
+     */
+    void set_nack(const std::string& sender_ip, uint16_t feedback_port, int delay_ms = 2, int retry_ms = 20)
+    {
+        udp_source_.stop();
+        udp_source_.set_nack(sender_ip, feedback_port, delay_ms, retry_ms);
+        udp_source_.start();
+    }
+
+    /**
+     * @brief Grant the sender credit for the frames this source can take in, see
+     * UdpSource::set_flow_control(). The receive threads are already running: this restarts them.
+     */
+    void set_flow_control(const std::string& sender_ip, uint16_t feedback_port, size_t frames = 0,
+                          uint64_t bytes = 0, int interval_ms = 10)
+    {
+        udp_source_.stop();
+        udp_source_.set_flow_control(sender_ip, feedback_port, frames, bytes, interval_ms);
+        udp_source_.start();
+    }
+
+    virtual Source_UDP<B, SourceImpl>* clone() const
     {
         // Cloning is strictly forbidden for this class.
         std::cerr << "Fatal: cloning Source_UDP is not allowed." << std::endl;
@@ -54,8 +95,22 @@ public:
 protected:
     void _generate(B *out_data, const size_t frame_id) override
     {
+        if (direct_mode_)
+        {
+            // Fragments are written straight into out_data by the receive thread
+            const size_t capacity = this->max_data_size * sizeof(B);
+            uint8_t* out_bytes = reinterpret_cast<uint8_t*>(out_data);
+            size_t received_size = udp_source_.pop_frame_into(out_bytes, capacity, timeout_ms_);
+
+            // Zero padding if received data is smaller than task buffer (or on timeout)
+            if (received_size < capacity) {
+                std::fill_n(out_bytes + received_size, capacity - received_size, 0);
+            }
+            return;
+        }
+
         // Blocking call to get a frame
-        std::vector<uint8_t> received_data = udp_source_.pop_frame(timeout_ms_);
+        FrameBuffer received_data = udp_source_.pop_frame(timeout_ms_);
 
         if (received_data.empty())
         {
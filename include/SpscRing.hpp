@@ -0,0 +1,100 @@
+/**
+ * @file SpscRing.hpp
+ * @brief Bounded lock-free single-producer/single-consumer ring.
+ *
+ * Used to hand completed frames from the receive thread to the consumer.
+ * A push or pop costs one acquire load (only when the cached index is stale)
+ * and one release store: no mutex, no syscall.
+ */
+
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+template <typename T>
+class SpscRing {
+private:
+    std::vector<T> slots_;
+    size_t mask_;
+
+    // Consumer side (head_ is written by the consumer only)
+    // Padding keeps the two sides on separate cache lines (no false sharing).
+    char pad0_[64];
+    std::atomic<size_t> head_{0};
+    size_t cached_tail_ = 0;
+
+    // Producer side (tail_ is written by the producer only)
+    char pad1_[64];
+    std::atomic<size_t> tail_{0};
+    size_t cached_head_ = 0;
+    char pad2_[64];
+
+public:
+    /**
+     * @param capacity Minimum number of slots (rounded up to a power of two).
+     */
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /**
+     * @brief Producer only. @return false if the ring is full ('value' is left untouched).
+     */
+    bool try_push(T&& value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_) return false;
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Consumer only. @return false if the ring is empty.
+     */
+    bool try_pop(T& out) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) return false;
+        }
+        out = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Consumer only. @return The oldest element, or nullptr if the ring is empty.
+     */
+    T* front() {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) return nullptr;
+        }
+        return &slots_[head & mask_];
+    }
+
+    /**
+     * @brief Consumer only.
+     */
+    bool empty() const {
+        return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+};
+
+#endif // SPSC_RING_HPP
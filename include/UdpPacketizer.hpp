@@ -10,6 +10,7 @@
 #define UDP_PACKETIZER_HPP
 
 #include "spu_udp_protocol.h"
+#include "FecCodec.hpp"
 #include <vector>
 #include <sys/uio.h> // For struct iovec
 #include <stdexcept>
@@ -20,10 +21,16 @@ class UdpPacketizer {
 public:
     // Represents a ready-to-send packet
     struct Packet {
-        SpuUdpHeader header;   // Local storage for the updated header struct
+        union {
+            SpuUdpHeader v1;
+            SpuUdpHeaderV2 v2;
+        } header;              // Local storage for the updated header struct (iov[0] has its length)
         struct iovec iov[2];   // Vector for sendmsg (0: Header, 1: Payload)
     };
 
+    // Payload size settable at runtime (see FixedUdpPacketizer)
+    static const bool FIXED_PAYLOAD = false;
+
 private:
     // Pool of pre-allocated packets to avoid dynamic allocation in the hot loop
     std::vector<Packet> packet_pool_;
@@ -31,12 +38,80 @@ private:
     // Number of valid packets for the current frame
     size_t current_count_ = 0;
 
+    uint8_t version_ = SPU_UDP_VERSION_1;
+    size_t payload_size_ = SPU_UDP_MAX_PAYLOAD;
+
+    // FEC: parity fragments per block of data fragments (0: none), their payloads
+    unsigned fec_block_len_ = 0;
+    unsigned fec_parity_count_ = 0;
+    std::vector<uint8_t> parity_;
+
 public:
     UdpPacketizer() {
         // Pre-allocate for ~10 MB frame size (approx 7500 packets)
         packet_pool_.reserve(8000);
     }
 
+    /**
+     * @brief Header written in front of each payload: SPU_UDP_VERSION_1 (default, understood
+     * by every receiver) or SPU_UDP_VERSION_2 (exact frame size and byte offset, see
+     * SpuUdpHeaderV2). Takes effect with the next prepare_frame().
+     * A payload size other than SPU_UDP_MAX_PAYLOAD always uses v2 (see set_payload_size()),
+     * so does FEC (see set_fec()).
+     */
+    void set_protocol_version(uint8_t version) {
+        if (version != SPU_UDP_VERSION_1 && version != SPU_UDP_VERSION_2)
+            throw std::invalid_argument("UdpPacketizer: unknown protocol version");
+        version_ = version;
+    }
+
+    /**
+     * @brief Version of the headers actually written.
+     */
+    uint8_t get_protocol_version() const {
+        return payload_size_ == SPU_UDP_MAX_PAYLOAD && fec_parity_count_ == 0 ? version_ : SPU_UDP_VERSION_2;
+    }
+
+    /**
+     * @brief Forward error correction: after every 'block_len' data fragments, send
+     * 'parity_count' parity fragments (see SPU_UDP_FLAG_PARITY), from which the receiver
+     * rebuilds up to 'parity_count' fragments lost in the block without a retransmission.
+     * Costs parity_count / block_len more bandwidth and an encoding pass over the frame
+     * (a plain XOR with a single parity fragment). 'parity_count' = 0 disables it.
+     * Parity fragments are v2 only: FEC switches the headers to v2.
+     * @throws std::invalid_argument if block_len is 0 or block_len + parity_count > SPU_UDP_FEC_MAX_SHARDS.
+     */
+    void set_fec(unsigned block_len, unsigned parity_count) {
+        if (parity_count > 0 && (block_len == 0 || block_len + parity_count > SPU_UDP_FEC_MAX_SHARDS))
+            throw std::invalid_argument("UdpPacketizer: FEC block out of range");
+        fec_block_len_ = parity_count > 0 ? block_len : 0;
+        fec_parity_count_ = parity_count;
+    }
+
+    unsigned get_fec_block_len() const { return fec_block_len_; }
+    unsigned get_fec_parity_count() const { return fec_parity_count_; }
+
+    /**
+     * @brief Payload bytes per fragment (the frame's last one may be shorter).
+     * v1 receivers place fragments at frag_index * SPU_UDP_MAX_PAYLOAD: any other
+     * size switches to v2 headers, which carry the offset.
+     * @throws std::invalid_argument if the datagram would exceed SPU_UDP_MAX_DATAGRAM.
+     */
+    void set_payload_size(size_t bytes) {
+        if (bytes == 0 || bytes + SPU_UDP_V2_HEADER_SIZE > SPU_UDP_MAX_DATAGRAM)
+            throw std::invalid_argument("UdpPacketizer: payload size out of range");
+        payload_size_ = bytes;
+    }
+
+    size_t get_payload_size() const { return payload_size_; }
+
+    /**
+     * @brief Header bytes in front of each payload for the current version.
+     */
+    size_t get_header_size() const {
+        return get_protocol_version() == SPU_UDP_VERSION_2 ? SPU_UDP_V2_HEADER_SIZE : sizeof(SpuUdpHeader);
+    }
+
     /**
      * @brief Prepares a frame for transmission by fragmenting it.
      *
@@ -46,43 +121,64 @@ public:
      * @return The number of fragments generated.
      */
     size_t prepare_frame(const void* data, size_t size, uint32_t frame_id) {
-        if (size > SPU_UDP_MAX_FRAME_SIZE) { // Updated constant
-            throw std::runtime_error("Streampu: Frame too large for protocol limits");
-        }
-
         // 1. Calculate required fragments
         // Integer division rounded up: ceil(size / payload_max)
-        size_t total_frags = (size + SPU_UDP_MAX_PAYLOAD - 1) / SPU_UDP_MAX_PAYLOAD; // Updated constant
+        const size_t payload_size = payload_size_;
+        size_t total_frags = (size + payload_size - 1) / payload_size;
+        if (total_frags > 0xFFFFFFFFu) { // total_frags is 32-bit on the wire
+            throw std::runtime_error("Streampu: Frame too large for protocol limits");
+        }
 
         // Edge case: If size is 0 (empty frame), we still send 1 packet with 0 payload
         if (total_frags == 0) total_frags = 1;
 
+        // FEC: room for the parity packets after each block
+        const bool fec = fec_parity_count_ > 0 && size > 0;
+        const size_t packet_count = fec ? fec_packet_count(total_frags, fec_block_len_, fec_parity_count_) : total_frags;
+
         // 2. Expand pool if necessary (should happen rarely after warmup)
-        if (total_frags > packet_pool_.size()) {
-            packet_pool_.resize(total_frags);
+        if (packet_count > packet_pool_.size()) {
+            packet_pool_.resize(packet_count);
         }
 
         const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        const size_t header_size = get_header_size();
+        const bool v2 = get_protocol_version() == SPU_UDP_VERSION_2;
         size_t remaining = size;
         size_t offset = 0;
+        size_t pos = 0;
 
         // 3. Fragmentation Loop
         // We iterate through the pool and configure pointers. No data copy happens here.
         for (size_t i = 0; i < total_frags; ++i) {
-            Packet& p = packet_pool_[i];
+            Packet& p = packet_pool_[pos++];
+            if (fec && ((i + 1) % fec_block_len_ == 0 || i + 1 == total_frags)) pos += fec_parity_count_;
 
             // A. Fill the Header
-            p.header.frame_id = frame_id;
-            p.header.frag_index = static_cast<uint32_t>(i);       // Updated type
-            p.header.total_frags = static_cast<uint32_t>(total_frags); // Updated type
+            if (v2) {
+                SpuUdpHeaderV2& h = p.header.v2;
+                h.magic = SPU_UDP_V2_MAGIC;
+                h.version = SPU_UDP_VERSION_2;
+                h.flags = 0;
+                h.header_size = static_cast<uint16_t>(SPU_UDP_V2_HEADER_SIZE);
+                h.frame_id = frame_id;
+                h.frag_index = static_cast<uint32_t>(i);
+                h.total_frags = static_cast<uint32_t>(total_frags);
+                h.frame_size = size;
+                h.offset = offset;
+            } else {
+                p.header.v1.frame_id = frame_id;
+                p.header.v1.frag_index = static_cast<uint32_t>(i);       // Updated type
+                p.header.v1.total_frags = static_cast<uint32_t>(total_frags); // Updated type
+            }
 
             // B. Calculate Payload Chunk Size
-            size_t chunk_size = std::min(remaining, static_cast<size_t>(SPU_UDP_MAX_PAYLOAD)); // Updated constant
+            size_t chunk_size = std::min(remaining, payload_size);
 
             // C. Configure I/O Vector (Scatter/Gather)
             // Element 0: Points to our local header
             p.iov[0].iov_base = &p.header;
-            p.iov[0].iov_len = sizeof(SpuUdpHeader); // Updated type
+            p.iov[0].iov_len = header_size;
 
             // Element 1: Points to the user's buffer slice
             p.iov[1].iov_base = const_cast<void*>(static_cast<const void*>(bytes + offset));
@@ -93,10 +189,66 @@ public:
             remaining -= chunk_size;
         }
 
-        current_count_ = total_frags;
+        if (fec) add_parity(packet_pool_.data(), total_frags, size, frame_id, fec_block_len_, fec_parity_count_,
+                            payload_size, parity_);
+        current_count_ = packet_count;
         return current_count_;
     }
 
+    /**
+     * @brief FEC: packets of a frame of 'total_frags' data fragments, parity included.
+     */
+    static size_t fec_packet_count(size_t total_frags, unsigned block_len, unsigned parity_count) {
+        return total_frags + (total_frags + block_len - 1) / block_len * parity_count;
+    }
+
+    /**
+     * @brief FEC: encode the parity packets of a prepared frame, whose data packets are
+     * laid out block by block with 'parity_count' free packets after each block.
+     * Their payloads ('payload_size' bytes each) are kept in 'storage'.
+     */
+    static void add_parity(Packet* packets, size_t total_frags, size_t frame_size, uint32_t frame_id,
+                           unsigned block_len, unsigned parity_count, size_t payload_size,
+                           std::vector<uint8_t>& storage) {
+        const size_t n_blocks = (total_frags + block_len - 1) / block_len;
+        if (storage.size() < n_blocks * parity_count * payload_size)
+            storage.resize(n_blocks * parity_count * payload_size);
+
+        const uint8_t* data[SPU_UDP_FEC_MAX_SHARDS];
+        size_t data_lens[SPU_UDP_FEC_MAX_SHARDS];
+        uint8_t* parity[SPU_UDP_FEC_MAX_SHARDS];
+        Packet* block = packets;
+        for (size_t b = 0; b < n_blocks; ++b) {
+            const size_t first = b * block_len;
+            const unsigned n = static_cast<unsigned>(std::min<size_t>(block_len, total_frags - first));
+            for (unsigned i = 0; i < n; ++i) {
+                data[i] = static_cast<const uint8_t*>(block[i].iov[1].iov_base);
+                data_lens[i] = block[i].iov[1].iov_len;
+            }
+            for (unsigned j = 0; j < parity_count; ++j) {
+                Packet& p = block[n + j];
+                parity[j] = &storage[(b * parity_count + j) * payload_size];
+
+                SpuUdpHeaderV2& h = p.header.v2;
+                h.magic = SPU_UDP_V2_MAGIC;
+                h.version = SPU_UDP_VERSION_2;
+                h.flags = SPU_UDP_FLAG_PARITY;
+                h.header_size = static_cast<uint16_t>(SPU_UDP_V2_HEADER_SIZE);
+                h.frame_id = frame_id;
+                h.frag_index = static_cast<uint32_t>(first);
+                h.total_frags = static_cast<uint32_t>(total_frags);
+                h.frame_size = frame_size;
+                h.offset = spu_udp_parity_offset(block_len, parity_count, j);
+                p.iov[0].iov_base = &p.header;
+                p.iov[0].iov_len = SPU_UDP_V2_HEADER_SIZE;
+                p.iov[1].iov_base = parity[j];
+                p.iov[1].iov_len = payload_size;
+            }
+            FecCodec::encode(data, data_lens, n, parity, parity_count, payload_size);
+            block += n + parity_count;
+        }
+    }
+
     /**
      * @brief Access the prepared packets.
      * @return Pointer to the array of Packet structures.
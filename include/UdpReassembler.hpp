@@ -9,117 +9,1255 @@
 #define UDP_REASSEMBLER_HPP
 
 #include "spu_udp_protocol.h"
+#include "FrameBufferPool.hpp"
+#include "FragmentBitmap.hpp"
+#include "FecCodec.hpp"
 #include <vector>
-#include <map>
 #include <cstring>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+
+/**
+ * @brief Frame returned by UdpReassembler::add_fragment() and friends.
+ */
+struct ReassemblyResult {
+    bool complete;
+    FrameBuffer data;    // Pooled: returns to the reassembler's pool when dropped
+    uint32_t frame_id;
+    bool in_target;      // True if the frame was reassembled into the target buffer (data is empty)
+    size_t target_size;  // Number of bytes written into the target buffer
+};
+
+/**
+ * @brief Pending frame dropped when a new one needs memory beyond the budget.
+ */
+enum class ReassemblyEvictionPolicy {
+    OLDEST_FIRST,           // Lowest frame_id: the frame least likely to still complete
+    LEAST_COMPLETE_FIRST    // Lowest fraction of fragments received: keeps the nearly done ones
+};
+
+/**
+ * @brief One received fragment of a batch (see UdpReassembler::add_fragments()).
+ */
+struct ReassemblyFragment {
+    SpuFragmentInfo info;   // See spu_udp_parse()
+    const uint8_t* payload;
+    size_t payload_len;
+};
+
+/**
+ * @brief Write address predicted for an upcoming fragment (see UdpReassembler::predict_slots()).
+ */
+struct ReassemblyPrediction {
+    uint32_t frame_id;
+    uint32_t frag_index;
+    uint8_t* slot;          // nullptr: no prediction, receive into a bounce buffer
+    size_t len;             // Bytes of the fragment's room at 'slot'
+};
+
+/**
+ * @brief Reassembler, optionally specialised for one stream geometry.
+ *
+ * PayloadSize (and FrameSize) fix the sender's payload size (and frame size) at compile
+ * time, 0 leaving them to the headers (UdpReassembler). Fragment offsets and the predicted
+ * stride are then multiples of a constant, and a fixed-size frame gets its exact buffer
+ * whatever the header version, with nothing to trim on completion. Fragments of another
+ * geometry are dropped. The wire format is the same.
+ */
+template <size_t PayloadSize = 0, size_t FrameSize = 0>
+class BasicUdpReassembler {
+    static_assert(FrameSize == 0 || PayloadSize != 0, "a fixed frame size needs a fixed payload size");
+    static_assert(PayloadSize + SPU_UDP_V2_HEADER_SIZE <= SPU_UDP_MAX_DATAGRAM, "payload does not fit in a datagram");
 
-class UdpReassembler {
 public:
-    struct Result {
-        bool complete;
-        std::vector<uint8_t> data;
-        uint32_t frame_id;
-    };
+    typedef ReassemblyResult Result;
+    typedef ReassemblyEvictionPolicy EvictionPolicy;
+    typedef ReassemblyFragment Fragment;
+    typedef ReassemblyPrediction Prediction;
+
+    static const size_t FIXED_PAYLOAD_SIZE = PayloadSize;
+    static const size_t FIXED_FRAME_SIZE = FrameSize;
+    static const size_t FIXED_FRAGMENTS = FrameSize == 0 ? 0 : (FrameSize + PayloadSize - 1) / (PayloadSize ? PayloadSize : 1);
+    static_assert(FIXED_FRAGMENTS <= 0xFFFFFFFFu, "too many fragments for the protocol");
 
 private:
+    /**
+     * @brief One slot of the reassembly window (slot index = frame_id % window).
+     */
     struct IncompleteFrame {
-        std::vector<uint8_t> buffer;
-        std::vector<bool> received_mask;
-        size_t received_count;
+        bool active = false;
+        bool done = false;      // Inactive after completing frame_id: its late fragments are dropped
+        uint32_t frame_id = 0;
+        FrameBuffer buffer;
+        uint8_t* base;          // Write pointer: buffer.data() or the external target
+        size_t capacity;        // Usable bytes behind 'base'
+        bool in_target;
+        bool lazy;              // Reserved mapping committed chunk by chunk (large frames)
+        FragmentBitmap committed_chunks;
+        FragmentBitmap received_mask;
+        size_t received_count;  // received_mask.count(), kept up to date per fragment
         uint32_t total_frags;   // Updated type
         size_t final_data_size;
-        std::chrono::steady_clock::time_point last_update;
+        bool sized;             // v2: final_data_size comes from the header, buffer allocated exact
+        size_t charged = 0;     // Bytes counted against the memory budget (0 in the target)
+        size_t buffer_charged = 0;  // Part of 'charged' for the frame buffer itself
+        size_t written_end = 0; // Highest byte written + 1 (what a target adopting the frame copies)
+        uint64_t slot_batch = 0;  // Last predict_slots() batch that handed out slots in the frame
+        uint64_t expiry_tick;   // Pushed back by every fragment
+        uint32_t timer_bucket;  // Timer wheel list the slot is linked in
+        uint32_t timer_prev;
+        uint32_t timer_next;
+        uint32_t received_end;  // Highest frag_index received + 1
+        int64_t last_fragment_us;
+        int64_t nack_after_us;  // Retransmission: no NACK before (retry interval)
+
+        // FEC: set up by the frame's first parity fragment (see SPU_UDP_FLAG_PARITY)
+        bool fec = false;
+        uint32_t fec_block_len;
+        uint32_t fec_parity_count;
+        size_t fec_stride;                      // Data fragment spacing = parity payload size
+        FrameBuffer fec_parity;                 // Payload of parity 'row' of block 'b' at (b * parity_count + row) * stride
+        FragmentBitmap fec_parity_mask;
+        std::vector<uint16_t> fec_data_count;   // Data fragments received per block
+        std::vector<uint16_t> fec_parity_received;
     };
 
-    std::map<uint32_t, IncompleteFrame> pending_frames_;
+    // Frame IDs increase monotonically: the frames still being reassembled are the
+    // last 'window' IDs up to newest_id_, each in its own slot. Any active slot
+    // holds a frame in (newest_id_ - window, newest_id_].
+    std::vector<IncompleteFrame> slots_;
+    uint32_t window_mask_ = 0;
+    uint32_t newest_id_ = 0;
+    bool has_newest_ = false;
+
+    // Hashed timer wheel: pending frames are linked (by slot index) in the bucket of
+    // their expiry tick. A fragment only pushes expiry_tick back; the frame is moved
+    // to its new bucket when its old one comes up, so each tick costs one bucket.
+    static const uint32_t WHEEL_SIZE = 64;
+    static const uint32_t NO_SLOT = 0xFFFFFFFFu;
+    uint32_t wheel_[WHEEL_SIZE];
+    uint64_t now_tick_ = 0;
+    uint64_t last_activity_tick_ = 0;
+    int frame_timeout_ms_ = 1000;
+    int64_t tick_ms_ = 1;
+    uint64_t timeout_ticks_ = 1;
+    size_t expired_frames_ = 0;
+
+    // Memory budget: pool buffers held by pending frames (the target is the consumer's memory)
+    size_t memory_budget_ = DEFAULT_MEMORY_BUDGET;
+    size_t pending_bytes_ = 0;
+    EvictionPolicy eviction_policy_ = EvictionPolicy::OLDEST_FIRST;
+    size_t rejected_frames_ = 0;
+    size_t evicted_frames_ = 0;
+
+    // Large frames: address space reserved up front, memory committed per chunk
+    size_t lazy_threshold_ = DEFAULT_LAZY_THRESHOLD;
+
+    // Payload bytes between consecutive fragments, learned from the size of fragment 0
+    // (v2 senders may use another payload size): used to predict slots
+    size_t stride_ = SPU_UDP_MAX_PAYLOAD;
+    std::vector<uint8_t> commit_copy_;  // commit_fragment() fallback
+
+    // Scatter batch in progress (predict_slots() until end_commit()): its frames are not
+    // evicted, and the buffers of those dropped anyway (window, restart) are kept until
+    // the end of the batch, since fragments may still be committed from their slots
+    uint64_t batch_ = 0;
+    bool batch_open_ = false;
+    std::vector<FrameBuffer> retired_;
 
-    const size_t MAX_PENDING_FRAMES = 10;
-    const int FRAME_TIMEOUT_MS = 1000;
+    // FEC block geometry of the stream, learned from its parity fragments (0: none): the
+    // parity fragments following each block are left out of the predicted slots
+    uint32_t fec_block_len_ = 0;
+    uint32_t fec_parity_count_ = 0;
+    size_t recovered_fragments_ = 0;
+    std::vector<uint8_t> fec_scratch_;
+
+    // Retransmission: frames quiet for the NACK delay are reported, then every retry interval
+    int nack_delay_ms_ = -1;
+    int nack_retry_ms_ = 0;
+    int64_t now_us_ = 0;
+
+    // Recycled, uninitialized frame buffers (shared with the FrameBuffers handed out)
+    std::shared_ptr<FrameBufferPool> pool_ = std::make_shared<FrameBufferPool>();
+
+    // External destination buffer (Direct Mode)
+    uint8_t* target_data_ = nullptr;
+    size_t target_capacity_ = 0;
+    bool target_in_use_ = false;
 
 public:
-    UdpReassembler() = default;
+    static const size_t DEFAULT_WINDOW = 16;
+    static const size_t DEFAULT_MEMORY_BUDGET = size_t(512) << 20;
+    static const size_t DEFAULT_LAZY_THRESHOLD = size_t(64) << 20;
+    static const size_t LAZY_CHUNK_SIZE = size_t(2) << 20;
+
+    /**
+     * @param window Number of consecutive frame IDs reassembled concurrently (see set_window()).
+     */
+    explicit BasicUdpReassembler(size_t window = DEFAULT_WINDOW) {
+        for (uint32_t b = 0; b < WHEEL_SIZE; ++b) wheel_[b] = NO_SLOT;
+        set_window(window);
+        set_frame_timeout(frame_timeout_ms_);
+    }
+
+    /**
+     * @brief Resize the reassembly window (rounded up to a power of two, at least 2).
+     *
+     * When a fragment of a newer frame arrives, frames falling out of the window
+     * are dropped. A fragment older than the window is dropped too, unless nothing
+     * was received for the frame timeout (sender restarted): the window then restarts
+     * from that frame. Frames pending in the current window are dropped.
+     */
+    void set_window(size_t window) {
+        size_t size = 2;
+        while (size < window && size < (size_t(1) << 31)) size <<= 1;
+
+        flush();
+        slots_.clear();
+        slots_.resize(size);
+        window_mask_ = static_cast<uint32_t>(size - 1);
+        has_newest_ = false;
+    }
+
+    size_t get_window() const { return slots_.size(); }
+
+    /**
+     * @brief Drop incomplete frames that received nothing for 'timeout_ms' (default 1000).
+     * Expiry has a granularity of about timeout_ms / 16. Frames pending now are dropped.
+     */
+    void set_frame_timeout(int timeout_ms) {
+        if (timeout_ms < 1) timeout_ms = 1;
+        flush();
+        frame_timeout_ms_ = timeout_ms;
+        tick_ms_ = timeout_ms >= 16 ? timeout_ms / 16 : 1;
+        timeout_ticks_ = static_cast<uint64_t>((timeout_ms + tick_ms_ - 1) / tick_ms_);
+        now_tick_ = current_tick(std::chrono::steady_clock::now());
+        has_newest_ = false;
+    }
+
+    int get_frame_timeout() const { return frame_timeout_ms_; }
+
+    /**
+     * @brief Drop the frames whose timeout elapsed. add_fragment() does it as it goes;
+     * call this when no packet arrives so that their memory is still released.
+     */
+    void expire_frames() {
+        advance_wheel(std::chrono::steady_clock::now());
+    }
+
+    /**
+     * @brief Number of incomplete frames dropped by the timeout so far.
+     */
+    size_t get_expired_frames() const { return expired_frames_; }
+
+    /**
+     * @brief Cap the buffer memory held by pending frames (default 512 MB).
+     *
+     * A frame is charged its full buffer (v1: fragment count x payload size, v2: its
+     * exact size, rounded to the pool size class) when it opens, a large frame each chunk it commits (see
+     * set_lazy_threshold()). A frame larger than the whole budget is rejected;
+     * otherwise pending frames are evicted following 'policy' until it fits.
+     * Frames reassembled in the Direct Mode target are not charged.
+     */
+    void set_memory_budget(size_t bytes, EvictionPolicy policy = EvictionPolicy::OLDEST_FIRST) {
+        memory_budget_ = bytes;
+        eviction_policy_ = policy;
+    }
+
+    size_t get_memory_budget() const { return memory_budget_; }
+
+    /**
+     * @brief Frames of at least 'bytes' (default 64 MB) reserve their address space
+     * and commit memory in LAZY_CHUNK_SIZE chunks as fragments land in them, instead
+     * of taking a whole pool buffer. They are charged to the memory budget per chunk,
+     * so memory follows what was received, not what was announced. The completed
+     * frame is the same contiguous mapping, trimmed to its exact size.
+     */
+    void set_lazy_threshold(size_t bytes) { lazy_threshold_ = bytes; }
+
+    size_t get_lazy_threshold() const { return lazy_threshold_; }
+
+    /**
+     * @brief Bytes currently charged to the memory budget.
+     */
+    size_t get_pending_bytes() const { return pending_bytes_; }
+
+    /**
+     * @brief Number of frames refused because they did not fit in the memory budget.
+     */
+    size_t get_rejected_frames() const { return rejected_frames_; }
+
+    /**
+     * @brief Number of incomplete frames dropped to make room: pushed out of the
+     * window by newer frames, or evicted by the memory budget.
+     */
+    size_t get_evicted_frames() const { return evicted_frames_; }
+
+    /**
+     * @brief Number of lost data fragments rebuilt from FEC parity fragments.
+     */
+    size_t get_recovered_fragments() const { return recovered_fragments_; }
+
+    /**
+     * @brief Retransmission: report the fragments missing from a frame (see poll_nack())
+     * once it received nothing for 'delay_ms', which leaves room for reordering, then
+     * every 'retry_ms' (about a round trip) while some are still missing.
+     * A negative delay disables it (default).
+     */
+    void set_nack(int delay_ms, int retry_ms) {
+        nack_delay_ms_ = delay_ms;
+        nack_retry_ms_ = retry_ms > 0 ? retry_ms : 1;
+    }
+
+    /**
+     * @brief Retransmission: next frame due for a NACK, and the runs of fragments to report.
+     *
+     * Gaps below the highest fragment received are reported once the frame went quiet.
+     * The fragments after it only once the sender has moved on (a newer frame arrived)
+     * or the frame stayed quiet for the retry interval: a pause of the sender is not
+     * a loss. A reported frame is due again after the retry interval.
+     * @return Number of ranges written to 'out' (at most 'max_ranges'), 0 if no frame is due.
+     */
+    size_t poll_nack(uint32_t& frame_id, FragmentRange* out, size_t max_ranges) {
+        advance_wheel(std::chrono::steady_clock::now());
+        if (nack_delay_ms_ < 0) return 0;
+        const int64_t delay_us = static_cast<int64_t>(nack_delay_ms_) * 1000;
+        const int64_t retry_us = static_cast<int64_t>(nack_retry_ms_) * 1000;
+
+        for (auto& frame : slots_) {
+            if (!frame.active || frame.received_count == 0 || now_us_ < frame.nack_after_us ||
+                now_us_ - frame.last_fragment_us < delay_us)
+                continue;
+
+            bool moved_on = serial_diff(newest_id_, frame.frame_id) > 0 || now_us_ - frame.last_fragment_us >= retry_us;
+            uint32_t end = moved_on ? frame.total_frags : frame.received_end;
+            size_t count = frame.received_mask.missing_ranges(out, max_ranges);
+            while (count > 0 && out[count - 1].first >= end) count--;
+            if (count == 0) continue;
+            if (out[count - 1].first + out[count - 1].count > end) out[count - 1].count = end - out[count - 1].first;
+
+            frame.nack_after_us = now_us_ + retry_us;
+            frame_id = frame.frame_id;
+            return count;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Number of frames currently being reassembled.
+     */
+    size_t get_pending_count() const {
+        size_t count = 0;
+        for (const auto& frame : slots_) count += frame.active;
+        return count;
+    }
+
+    /**
+     * @brief Pre-populate the buffer pool for frames of 'frame_size' bytes.
+     * v1 frames take a buffer rounded up to whole fragments, v2 frames an exact one:
+     * both size classes are filled when they differ. A fixed FrameSize takes precedence.
+     */
+    void preallocate(size_t frame_size, size_t count) {
+        if (FrameSize != 0 || (PayloadSize != 0 && PayloadSize != SPU_UDP_MAX_PAYLOAD)) {
+            pool_->preallocate(FrameSize != 0 ? FrameSize : frame_size, count);
+            return;
+        }
+        size_t total_frags = (frame_size + SPU_UDP_MAX_PAYLOAD - 1) / SPU_UDP_MAX_PAYLOAD;
+        size_t v1_size = total_frags * SPU_UDP_MAX_PAYLOAD;
+        pool_->preallocate(v1_size, count);
+        if (FrameBufferPool::class_size(frame_size) != FrameBufferPool::class_size(v1_size))
+            pool_->preallocate(frame_size, count);
+    }
+
+    const std::shared_ptr<FrameBufferPool>& get_pool() const { return pool_; }
+
+    /**
+     * @brief Direct Mode: reassemble the next new frame straight into 'dst'.
+     *
+     * Fragments landing beyond 'capacity' are dropped (the frame is truncated),
+     * which matches what the consumer would have kept after a copy anyway.
+     * The target stays armed until a frame completes in it or release_target() is called.
+     */
+    void set_target(void* dst, size_t capacity) {
+        target_data_ = static_cast<uint8_t*>(dst);
+        target_capacity_ = capacity;
+        target_in_use_ = false;
+    }
+
+    /**
+     * @brief Direct Mode: set_target(), and if 'frame_id' is already being reassembled
+     * the target takes it over: the part received so far is copied once, the rest lands
+     * in place. Otherwise the target goes to the next new frame, as with set_target().
+     * A consumer arming the target for the frame it expects next then gets it directly
+     * even when its first fragments arrived before (sustained streams).
+     */
+    void set_target(void* dst, size_t capacity, uint32_t frame_id) {
+        set_target(dst, capacity);
+        IncompleteFrame* frame = find_frame(frame_id);
+        if (frame == nullptr || frame->in_target) return;
+
+        uint8_t* target = static_cast<uint8_t*>(dst);
+        const size_t copy_size = std::min(frame->written_end, capacity);
+        if (frame->lazy) {
+            // Chunks never committed hold no fragment (and cannot be read)
+            for (size_t start = 0; start < copy_size; start += LAZY_CHUNK_SIZE) {
+                if (!frame->committed_chunks.test(start / LAZY_CHUNK_SIZE)) continue;
+                size_t bytes = copy_size - start;
+                if (bytes > LAZY_CHUNK_SIZE) bytes = LAZY_CHUNK_SIZE;
+                std::memcpy(target + start, frame->base + start, bytes);
+            }
+        } else {
+            std::memcpy(target, frame->base, copy_size);
+        }
+
+        release_buffer(*frame);
+        frame->charged -= frame->buffer_charged;
+        pending_bytes_ -= frame->buffer_charged;
+        frame->buffer_charged = 0;
+        frame->base = target;
+        frame->capacity = capacity;
+        frame->in_target = true;
+        frame->lazy = false;
+        target_in_use_ = true;
+    }
+
+    /**
+     * @brief Disarm the target. A frame partially reassembled in it is migrated
+     * to an internal buffer so that no fragment already received is lost.
+     */
+    void release_target() {
+        for (auto& frame : slots_) {
+            if (!frame.active || !frame.in_target) continue;
+
+            uint8_t* target = frame.base;
+            size_t copy_size = frame.capacity;
+            size_t size = frame.sized ? frame.final_data_size
+                                      : static_cast<size_t>(frame.total_frags) * SPU_UDP_MAX_PAYLOAD;
+            if (!allocate_buffer(frame, size, true)) {
+                erase_frame(frame);
+                continue;
+            }
+            copy_size = std::min(copy_size, frame.buffer.size());
+            if (frame.lazy && !ensure_committed(frame, 0, copy_size, true)) {
+                erase_frame(frame);
+                continue;
+            }
+
+            std::memcpy(frame.buffer.data(), target, copy_size);
+            frame.base = frame.buffer.data();
+            frame.capacity = frame.buffer.size();
+            frame.in_target = false;
+        }
+        target_data_ = nullptr;
+        target_capacity_ = 0;
+        target_in_use_ = false;
+    }
 
     Result add_fragment(const SpuUdpHeader& header, const void* payload, size_t payload_len) { // Updated type
-        Result res = {false, {}, header.frame_id};
+        return add_fragment(spu_udp_info(header), payload, payload_len);
+    }
+
+    /**
+     * @brief Add a fragment of either protocol version (see spu_udp_parse()).
+     * A v2 frame gets a buffer of its exact size and each payload lands at its offset.
+     */
+    Result add_fragment(const SpuFragmentInfo& info, const void* payload, size_t payload_len) {
+        advance_wheel(std::chrono::steady_clock::now());
+        return insert_fragment(info, payload, payload_len);
+    }
 
-        if (payload_len > SPU_UDP_MAX_PAYLOAD) return res; // Updated constant
+    /**
+     * @brief Add a whole receive batch: one clock read for the batch, and the frame
+     * of the previous fragment is reused without a lookup while fragments keep
+     * belonging to it.
+     * @param completed Frames completed by the batch are appended, in completion order.
+     * @return Number of frames appended.
+     */
+    size_t add_fragments(const Fragment* fragments, size_t count, std::vector<Result>& completed) {
+        advance_wheel(std::chrono::steady_clock::now());
 
-        // Cleanup logic...
-        if (pending_frames_.size() >= MAX_PENDING_FRAMES) {
-             cleanup_old_frames();
-             if (pending_frames_.find(header.frame_id) == pending_frames_.end()) return res;
+        size_t n_completed = 0;
+        IncompleteFrame* current = nullptr;
+        for (size_t i = 0; i < count; ++i) {
+            const Fragment& fragment = fragments[i];
+            if (!valid_fragment(fragment.info, fragment.payload_len)) continue;
+            if (fragment.info.is_parity()) {
+                Result res = insert_parity(fragment.info, fragment.payload, fragment.payload_len);
+                if (res.complete) {
+                    completed.push_back(std::move(res));
+                    n_completed++;
+                }
+                continue;
+            }
+
+            // The cached slot may have completed or been reused by another frame meanwhile
+            if (current == nullptr || !current->active || current->frame_id != fragment.info.frame_id ||
+                current->total_frags != fragment.info.total_frags) {
+                current = lookup_frame(fragment.info);
+                if (current == nullptr) continue;
+            }
+
+            Result res = copy_fragment(*current, fragment.info, fragment.payload, fragment.payload_len);
+            if (res.complete) {
+                completed.push_back(std::move(res));
+                n_completed++;
+                current = nullptr;
+            }
+        }
+        return n_completed;
+    }
+
+    /**
+     * @brief Scatter receive: predict where the next 'count' fragments must be written.
+     *
+     * Assumes in-order delivery after 'last' (the last fragment received), fragments
+     * spaced by the payload size seen so far. When the prediction runs past the end of
+     * the frame, the next frame is opened speculatively with the same fragment count
+     * (and size, for v2). Only slots not received yet are handed out. With FEC, the
+     * parity fragments expected after each block get no slot.
+     * Expired frames are dropped here, not by commit_fragment(): a predicted slot stays
+     * valid until the fragments received into it are committed, and end_commit() is called
+     * (or the next prediction starts).
+     */
+    void predict_slots(const SpuUdpHeader& last, Prediction* out, size_t count) {
+        predict_slots(spu_udp_info(last), out, count);
+    }
+
+    void predict_slots(const SpuFragmentInfo& last, Prediction* out, size_t count) {
+        end_commit();
+        advance_wheel(std::chrono::steady_clock::now());
+        batch_++;
+        batch_open_ = true;
+
+        const uint32_t total = last.total_frags;
+        const size_t stride = PayloadSize != 0 ? PayloadSize : stride_;
+        const uint32_t block_len = fec_block_len_;
+        SpuFragmentInfo next = last;
+        next.flags = 0;
+        uint32_t frame_id = last.frame_id;
+        uint32_t index = last.frag_index + 1;
+        uint32_t parity_left = 0;  // Parity fragments before data fragment 'index'
+        if (last.is_parity()) {
+            index = last.frag_index + last.fec_block_len();
+            if (last.fec_row() < last.fec_parity_count()) parity_left = last.fec_parity_count() - 1 - last.fec_row();
+        } else if (block_len > 0 && (index % block_len == 0 || index == total)) {
+            parity_left = fec_parity_count_;
         }
+        IncompleteFrame* found = find_frame(frame_id);
+        if (found == nullptr || total == 0) index = total; // Frame done: jump to the next one
 
-        auto it = pending_frames_.find(header.frame_id);
+        for (size_t n = 0; n < count; ++n) {
+            out[n].frame_id = frame_id;
+            out[n].frag_index = index;
+            out[n].slot = nullptr;
+            out[n].len = 0;
+            if (parity_left > 0) {
+                parity_left--;
+                continue;
+            }
 
-        if (it == pending_frames_.end()) {
-            IncompleteFrame new_frame;
+            if (index >= total) {
+                frame_id++;
+                index = 0;
+                found = find_frame(frame_id);
+                // Open speculatively only if that evicts no frame (its slot is free, the window moves by one at most)
+                if (found == nullptr && total > 0 && has_newest_ && serial_diff(frame_id, newest_id_) <= 1 &&
+                    !slots_[frame_id & window_mask_].active) {
+                    next.frame_id = frame_id;
+                    found = open_frame(next, false);
+                }
+            }
 
-            // Allocate max theoretical size initially
-            size_t total_max_size = static_cast<size_t>(header.total_frags) * SPU_UDP_MAX_PAYLOAD; // Updated constant
+            out[n].frame_id = frame_id;
+            out[n].frag_index = index;
+            const uint32_t predicted = index++;
+            if (block_len > 0 && (index % block_len == 0 || index == total)) parity_left = fec_parity_count_;
+            if (found == nullptr) continue;
 
-            if (total_max_size > SPU_UDP_MAX_FRAME_SIZE) return res; // Updated constant
+            // The last fragment of an exact-size (v2) frame only has the rest of the buffer
+            IncompleteFrame& frame = *found;
+            size_t offset = static_cast<size_t>(predicted) * stride;
+            size_t room = offset < frame.capacity ? std::min(stride, frame.capacity - offset) : 0;
+            if (frame.total_frags == total && predicted < total && !frame.received_mask.test(predicted) &&
+                room > 0 && (room == stride || predicted + 1 == total) &&
+                (!frame.lazy || ensure_committed(frame, offset, room, false))) {
+                out[n].slot = frame.base + offset;
+                out[n].len = room;
+                frame.slot_batch = batch_;
+            }
+        }
+    }
 
-            try {
-                new_frame.buffer.resize(total_max_size);
-                new_frame.received_mask.resize(header.total_frags, false);
-            } catch (const std::bad_alloc&) { return res; }
+    /**
+     * @brief Scatter receive: account for a fragment whose payload was received at 'where'.
+     *
+     * If 'where' is the fragment's slot in its frame, nothing is copied. Otherwise
+     * (stale prediction) this falls back to add_fragment(), copying from 'where'.
+     */
+    Result commit_fragment(const SpuUdpHeader& header, const uint8_t* where, size_t payload_len) {
+        return commit_fragment(spu_udp_info(header), where, payload_len);
+    }
 
-            new_frame.total_frags = header.total_frags;
-            new_frame.received_count = 0;
-            new_frame.final_data_size = total_max_size; // Default to max
-            new_frame.last_update = std::chrono::steady_clock::now();
+    Result commit_fragment(const SpuFragmentInfo& info, const uint8_t* where, size_t payload_len) {
+        IncompleteFrame* frame = find_frame(info.frame_id);
+        if (frame != nullptr && !info.is_parity() && valid_fragment(info, payload_len) &&
+            frame->total_frags == info.total_frags && info.frag_index < info.total_frags &&
+            !frame->received_mask.test(info.frag_index) && fragment_offset(info) + payload_len <= frame->capacity &&
+            where == frame->base + fragment_offset(info)) {
+            touch(*frame);
+            return receive(*frame, info, payload_len);
+        }
 
-            auto insert_res = pending_frames_.insert({header.frame_id, std::move(new_frame)});
-            it = insert_res.first;
+        // 'where' may be inside a frame the fallback drops (restarted with another size):
+        // take the payload out first
+        if (frame != nullptr) {
+            commit_copy_.assign(where, where + payload_len);
+            where = commit_copy_.data();
         }
+        return insert_fragment(info, where, payload_len);
+    }
+
+    /**
+     * @brief Scatter receive: every fragment received into the last predicted slots is
+     * committed. Their frames may be evicted again, buffers held for them are released.
+     */
+    void end_commit() {
+        batch_open_ = false;
+        retired_.clear();
+    }
 
-        IncompleteFrame& frame = it->second;
-        frame.last_update = std::chrono::steady_clock::now();
+    /**
+     * @brief Loss reporting: runs of fragments of 'frame_id' not received yet.
+     * @return Number of ranges written to 'out' (at most 'max_ranges'), 0 if the frame is not pending.
+     */
+    size_t get_missing_fragments(uint32_t frame_id, FragmentRange* out, size_t max_ranges) {
+        IncompleteFrame* frame = find_frame(frame_id);
+        if (frame == nullptr) return 0;
+        return frame->received_mask.missing_ranges(out, max_ranges);
+    }
+
+private:
+    Result insert_fragment(const SpuFragmentInfo& info, const void* payload, size_t payload_len) {
+        if (!valid_fragment(info, payload_len)) return {false, {}, info.frame_id, false, 0};
+        if (info.is_parity()) return insert_parity(info, payload, payload_len);
 
-        if (header.frag_index >= frame.total_frags) return res;
-        if (frame.received_mask[header.frag_index]) return res;
+        IncompleteFrame* frame = lookup_frame(info);
+        if (frame == nullptr) return {false, {}, info.frame_id, false, 0};
+        return copy_fragment(*frame, info, payload, payload_len);
+    }
 
+    /**
+     * @brief v1 payloads cannot exceed the fixed fragment spacing, v2 ones must lie in the frame.
+     * A fixed geometry must match too.
+     */
+    static bool valid_fragment(const SpuFragmentInfo& info, size_t payload_len) {
+        if (info.is_parity()) return valid_parity(info, payload_len);
+        if (info.frag_index >= info.total_frags) return false;
+        if (PayloadSize != 0 && !fixed_geometry(info, payload_len)) return false;
+        if (!info.has_frame_size()) return payload_len <= SPU_UDP_MAX_PAYLOAD; // Updated constant
+        // Each fragment carries a byte at least (an empty frame: one fragment), so more
+        // fragments than bytes is a forged header that would size the bitmap on its own
+        if (info.total_frags > std::max<uint64_t>(info.frame_size, 1)) return false;
+        return info.offset <= info.frame_size && payload_len <= info.frame_size - info.offset;
+    }
+
+    /**
+     * @brief Fragment of the stream this reassembler is specialised for: payloads spaced by
+     * PayloadSize (so v1 only when it is SPU_UDP_MAX_PAYLOAD), FrameSize bytes if fixed.
+     */
+    static bool fixed_geometry(const SpuFragmentInfo& info, size_t payload_len) {
+        if (payload_len > PayloadSize) return false;
+        if (info.has_frame_size() ? info.offset != static_cast<uint64_t>(info.frag_index) * PayloadSize
+                                  : PayloadSize != SPU_UDP_MAX_PAYLOAD)
+            return false;
+        return FrameSize == 0 ||
+               (info.total_frags == FIXED_FRAGMENTS && (!info.has_frame_size() || info.frame_size == FrameSize));
+    }
+
+    /**
+     * @brief Parity fragment of a well-formed block (see SPU_UDP_FLAG_PARITY): its payload
+     * is the data fragments' stride, so the frame must span total_frags strides.
+     */
+    static bool valid_parity(const SpuFragmentInfo& info, size_t payload_len) {
+        const unsigned block_len = info.fec_block_len();
+        const unsigned parity_count = info.fec_parity_count();
+        if (block_len == 0 || info.fec_row() >= parity_count || block_len + parity_count > SPU_UDP_FEC_MAX_SHARDS)
+            return false;
+        if ((info.offset & ~static_cast<uint64_t>(0xFFFFFF)) != SPU_UDP_PARITY_OFFSET) return false;
+        if (info.frag_index >= info.total_frags || info.frag_index % block_len != 0) return false;
+        if (payload_len == 0 || info.frame_size == 0) return false;
+        if (static_cast<uint64_t>(info.total_frags - 1) * payload_len >= info.frame_size ||
+            info.frame_size > static_cast<uint64_t>(info.total_frags) * payload_len)
+            return false;
+        if (PayloadSize != 0 && payload_len != PayloadSize) return false;
+        return FrameSize == 0 || (info.total_frags == FIXED_FRAGMENTS && info.frame_size == FrameSize);
+    }
+
+    /**
+     * @brief Byte offset of a fragment in its frame: a product by a constant when the
+     * payload size is fixed (valid_fragment() checked that the header agrees).
+     */
+    static size_t fragment_offset(const SpuFragmentInfo& info) {
+        if (PayloadSize != 0) return static_cast<size_t>(info.frag_index) * PayloadSize;
+        return static_cast<size_t>(info.offset);
+    }
+
+    /**
+     * @brief Frame a fragment belongs to, opened if needed (nullptr: the fragment is dropped).
+     */
+    IncompleteFrame* lookup_frame(const SpuFragmentInfo& info) {
+        IncompleteFrame* found = find_frame(info.frame_id);
+
+        // A frame opened by predict_slots() with the wrong fragment count (or size) is restarted.
+        // A fixed frame size leaves nothing to guess.
+        if (FrameSize == 0 && found != nullptr && found->received_count == 0 &&
+            (found->total_frags != info.total_frags || found->sized != info.has_frame_size() ||
+             (found->sized && found->final_data_size != info.frame_size))) {
+            erase_frame(*found);
+            found = nullptr;
+        }
+
+        if (found == nullptr) found = open_frame(info);
+        return found;
+    }
+
+    Result copy_fragment(IncompleteFrame& frame, const SpuFragmentInfo& info, const void* payload, size_t payload_len) {
+        Result res = {false, {}, info.frame_id, false, 0};
+        touch(frame);
+
+        if (info.frag_index >= frame.total_frags) return res;
+        if (frame.received_mask.test(info.frag_index)) return res;
         // 1. Copy Data
-        size_t offset = static_cast<size_t>(header.frag_index) * SPU_UDP_MAX_PAYLOAD; // Updated constant
-        if (offset + payload_len <= frame.buffer.size()) {
-            std::memcpy(frame.buffer.data() + offset, payload, payload_len);
+        size_t offset = fragment_offset(info);
+        if (frame.sized && offset + payload_len > frame.final_data_size) return res;
+        if (frame.lazy && offset < frame.capacity &&
+            !ensure_committed(frame, offset, std::min(payload_len, frame.capacity - offset), true))
+            return res;
+        if (offset + payload_len <= frame.capacity) {
+            std::memcpy(frame.base + offset, payload, payload_len);
+        } else if (offset < frame.capacity) {
+            std::memcpy(frame.base + offset, payload, frame.capacity - offset);
+        }
+
+        return receive(frame, info, payload_len);
+    }
+
+    /**
+     * @brief mark_received(), then FEC recovery of the fragment's block if it became possible.
+     */
+    Result receive(IncompleteFrame& frame, const SpuFragmentInfo& info, size_t payload_len) {
+        Result res = mark_received(frame, info, payload_len);
+        if (!res.complete && frame.fec) return recover_block(frame, info.frag_index / frame.fec_block_len);
+        return res;
+    }
+
+    /**
+     * @brief Store a parity fragment in its frame and rebuild what it makes recoverable.
+     * It opens a frame newer than any seen, but never reopens a completed (or dropped) one.
+     */
+    Result insert_parity(const SpuFragmentInfo& info, const void* payload, size_t payload_len) {
+        Result res = {false, {}, info.frame_id, false, 0};
+        fec_block_len_ = info.fec_block_len();
+        fec_parity_count_ = info.fec_parity_count();
+
+        if (find_frame(info.frame_id) == nullptr && has_newest_ && serial_diff(info.frame_id, newest_id_) <= 0)
+            return res;
+        IncompleteFrame* frame = lookup_frame(info);
+        if (frame == nullptr || !frame->sized || frame->total_frags != info.total_frags ||
+            frame->final_data_size != info.frame_size)
+            return res;
+        touch(*frame);
+        if (!setup_fec(*frame, info, payload_len)) return res;
+
+        const uint32_t block = info.frag_index / frame->fec_block_len;
+        const size_t index = static_cast<size_t>(block) * frame->fec_parity_count + info.fec_row();
+        if (!frame->fec_parity_mask.set(index)) return res;
+        std::memcpy(frame->fec_parity.data() + index * frame->fec_stride, payload, payload_len);
+        frame->fec_parity_received[block]++;
+        return recover_block(*frame, block);
+    }
+
+    /**
+     * @brief First parity fragment of 'frame': parity buffer (charged to the budget) and
+     * per block counters. @return false if the geometry differs from the frame's
+     * first parity fragment or the buffer does not fit.
+     */
+    bool setup_fec(IncompleteFrame& frame, const SpuFragmentInfo& info, size_t stride) {
+        const uint32_t block_len = info.fec_block_len();
+        const uint32_t parity_count = info.fec_parity_count();
+        if (frame.fec)
+            return frame.fec_block_len == block_len && frame.fec_parity_count == parity_count &&
+                   frame.fec_stride == stride;
+
+        const size_t n_blocks = (static_cast<size_t>(frame.total_frags) + block_len - 1) / block_len;
+        const size_t size = n_blocks * parity_count * stride;
+        const size_t cost = FrameBufferPool::class_size(size);
+        if (!make_room(cost, true, &frame)) return false;
+        try {
+            frame.fec_parity = pool_->acquire(size);
+            frame.fec_parity_mask.reset(n_blocks * parity_count);
+            frame.fec_data_count.assign(n_blocks, 0);
+            frame.fec_parity_received.assign(n_blocks, 0);
+        } catch (const std::bad_alloc&) {
+            frame.fec_parity.reset();
+            return false;
+        }
+        charge(frame, cost);
+
+        for (uint32_t i = 0; i < frame.total_frags; ++i)
+            if (frame.received_mask.test(i)) frame.fec_data_count[i / block_len]++;
+        frame.fec = true;
+        frame.fec_block_len = block_len;
+        frame.fec_parity_count = parity_count;
+        frame.fec_stride = stride;
+        return true;
+    }
+
+    /**
+     * @brief Rebuild the missing data fragments of 'block' once as many parity fragments
+     * as missing ones arrived. The block must lie in the frame buffer (not truncated).
+     */
+    Result recover_block(IncompleteFrame& frame, uint32_t block) {
+        Result res = {false, {}, frame.frame_id, false, 0};
+        const uint32_t first = block * frame.fec_block_len;
+        const unsigned n = std::min(frame.fec_block_len, frame.total_frags - first);
+        const unsigned have = frame.fec_data_count[block];
+        if (have >= n || have + frame.fec_parity_received[block] < n) return res;
+
+        const size_t stride = frame.fec_stride;
+        const size_t begin = static_cast<size_t>(first) * stride;
+        const size_t end = std::min(frame.final_data_size, begin + n * stride);
+        if (end > frame.capacity) return res;
+        if (frame.lazy && !ensure_committed(frame, begin, end - begin, true)) return res;
+
+        const uint8_t* data[SPU_UDP_FEC_MAX_SHARDS];
+        size_t data_lens[SPU_UDP_FEC_MAX_SHARDS];
+        unsigned lost[SPU_UDP_FEC_MAX_SHARDS];
+        const uint8_t* parity[SPU_UDP_FEC_MAX_SHARDS];
+        unsigned rows[SPU_UDP_FEC_MAX_SHARDS];
+        uint8_t* out[SPU_UDP_FEC_MAX_SHARDS];
+        unsigned m = 0;
+        for (unsigned i = 0; i < n; ++i) {
+            const size_t offset = begin + i * stride;
+            data[i] = frame.base + offset;
+            data_lens[i] = std::min(stride, end - offset);
+            if (!frame.received_mask.test(first + i)) lost[m++] = i;
+        }
+        unsigned r = 0;
+        for (unsigned row = 0; row < frame.fec_parity_count && r < m; ++row) {
+            const size_t index = static_cast<size_t>(block) * frame.fec_parity_count + row;
+            if (!frame.fec_parity_mask.test(index)) continue;
+            parity[r] = frame.fec_parity.data() + index * stride;
+            rows[r++] = row;
+        }
+        if (fec_scratch_.size() < m * stride) fec_scratch_.resize(m * stride);
+        for (unsigned t = 0; t < m; ++t) out[t] = &fec_scratch_[t * stride];
+        if (!FecCodec::decode(data, data_lens, n, lost, m, parity, rows, frame.fec_parity_count, out, stride))
+            return res;
+
+        SpuFragmentInfo info;
+        info.frame_id = frame.frame_id;
+        info.total_frags = frame.total_frags;
+        info.version = SPU_UDP_VERSION_2;
+        info.flags = 0;
+        info.header_size = static_cast<uint16_t>(SPU_UDP_V2_HEADER_SIZE);
+        info.frame_size = frame.final_data_size;
+        for (unsigned t = 0; t < m; ++t) {
+            info.frag_index = first + lost[t];
+            info.offset = static_cast<uint64_t>(info.frag_index) * stride;
+            std::memcpy(frame.base + info.offset, out[t], data_lens[lost[t]]);
+            recovered_fragments_++;
+            res = mark_received(frame, info, data_lens[lost[t]]);
+            if (res.complete) break;
+        }
+        return res;
+    }
+
+    /**
+     * @brief Give the parity buffer back (the budget is uncharged with the frame).
+     */
+    void release_fec(IncompleteFrame& frame) {
+        frame.fec = false;
+        frame.fec_parity.reset();
+    }
+
+    /**
+     * @brief Wraparound-safe frame ID ordering: > 0 if 'a' is newer than 'b'.
+     */
+    static int32_t serial_diff(uint32_t a, uint32_t b) {
+        return static_cast<int32_t>(a - b);
+    }
+
+    IncompleteFrame* find_frame(uint32_t frame_id) {
+        IncompleteFrame& frame = slots_[frame_id & window_mask_];
+        return (frame.active && frame.frame_id == frame_id) ? &frame : nullptr;
+    }
+
+    /**
+     * @brief Move the window so that it covers 'frame_id' and return its (free) slot.
+     * @return nullptr if 'frame_id' is older than the window.
+     */
+    IncompleteFrame* claim_slot(uint32_t frame_id) {
+        const uint32_t window = window_mask_ + 1;
+
+        if (!has_newest_) {
+            newest_id_ = frame_id;
+            has_newest_ = true;
+        } else if (serial_diff(frame_id, newest_id_) > 0) {
+            // Frames falling out of the window share their slot with the new IDs
+            uint32_t steps = frame_id - newest_id_;
+            if (steps >= window) evicted_frames_ += flush();
+            else for (uint32_t i = 1; i <= steps; ++i) {
+                IncompleteFrame& stale = slots_[(newest_id_ + i) & window_mask_];
+                if (stale.active) {
+                    erase_frame(stale);
+                    evicted_frames_++;
+                }
+            }
+            newest_id_ = frame_id;
+        } else if (newest_id_ - frame_id >= window) {
+            // Late fragment of a dropped frame, or a restarted sender once the old stream went quiet
+            if (now_tick_ - last_activity_tick_ <= timeout_ticks_) return nullptr;
+            flush();
+            newest_id_ = frame_id;
+        }
+
+        return &slots_[frame_id & window_mask_];
+    }
+
+    /**
+     * @param may_evict false: do not evict pending frames to fit (speculative open).
+     */
+    IncompleteFrame* open_frame(const SpuFragmentInfo& info, bool may_evict = true) {
+        const uint32_t frame_id = info.frame_id;
+        const uint32_t total_frags = info.total_frags;
+
+        // v2 or fixed FrameSize: exact size. v1: max theoretical size, trimmed when the last fragment arrives
+        const bool sized = FrameSize != 0 || info.has_frame_size();
+        size_t total_max_size = static_cast<size_t>(total_frags) * SPU_UDP_MAX_PAYLOAD; // Updated constant
+        if (FrameSize != 0) total_max_size = FrameSize;
+        else if (info.has_frame_size()) total_max_size = static_cast<size_t>(info.frame_size);
+        else if (total_max_size > SPU_UDP_MAX_FRAME_SIZE) return nullptr; // Updated constant
+
+        // Late (or retransmitted) fragment of a frame already delivered, unless the stream restarted
+        const IncompleteFrame& previous = slots_[frame_id & window_mask_];
+        if (previous.done && previous.frame_id == frame_id && now_tick_ - last_activity_tick_ <= timeout_ticks_)
+            return nullptr;
+
+        // Bitmaps of more than FragmentBitmap::INLINE_BITS fragments are charged too
+        const size_t bitmap_bytes = FragmentBitmap::heap_bytes(total_frags);
+        bool direct = target_data_ != nullptr && !target_in_use_;
+        if (!direct && total_max_size + bitmap_bytes > memory_budget_) {
+            rejected_frames_++;
+            return nullptr;
         }
 
+        IncompleteFrame* slot = claim_slot(frame_id);
+        if (slot == nullptr) return nullptr;
+        IncompleteFrame& new_frame = *slot;
+
+        if (direct) {
+            // Direct Mode: the consumer's buffer becomes the frame buffer
+            new_frame.base = target_data_;
+            new_frame.capacity = target_capacity_;
+            new_frame.in_target = true;
+            new_frame.lazy = false;
+        } else if (!allocate_buffer(new_frame, total_max_size, may_evict)) {
+            return nullptr;
+        }
+        try {
+            if (!make_room(bitmap_bytes, may_evict, &new_frame)) throw std::bad_alloc();
+            new_frame.received_mask.reset(total_frags);
+            charge(new_frame, bitmap_bytes);
+        } catch (const std::bad_alloc&) {
+            new_frame.buffer.reset();
+            uncharge(new_frame);
+            return nullptr;
+        }
+        if (new_frame.in_target) target_in_use_ = true;
+
+        new_frame.active = true;
+        new_frame.done = false;
+        new_frame.frame_id = frame_id;
+        new_frame.total_frags = total_frags;
+        new_frame.received_count = 0;
+        new_frame.final_data_size = total_max_size; // Default to max
+        new_frame.sized = sized;
+        new_frame.expiry_tick = now_tick_ + timeout_ticks_;
+        new_frame.received_end = 0;
+        new_frame.written_end = 0;
+        new_frame.last_fragment_us = now_us_;
+        new_frame.nack_after_us = 0;
+        timer_link(new_frame);
+
+        return &new_frame;
+    }
+
+    Result mark_received(IncompleteFrame& frame, const SpuFragmentInfo& info, size_t payload_len) {
+        Result res = {false, {}, info.frame_id, false, 0};
+
         // 2. If this is the LAST fragment, we found the real end of the frame!
-        if (header.frag_index == header.total_frags - 1) {
-            frame.final_data_size = offset + payload_len;
+        if (!frame.sized && info.frag_index == info.total_frags - 1) {
+            frame.final_data_size = fragment_offset(info) + payload_len;
         }
+        if (PayloadSize == 0 && info.frag_index == 0 && info.total_frags > 1 && payload_len > 0) stride_ = payload_len;
 
-        frame.received_mask[header.frag_index] = true;
+        frame.received_mask.set(info.frag_index);
         frame.received_count++;
+        if (info.frag_index >= frame.received_end) frame.received_end = info.frag_index + 1;
+        frame.written_end = std::max(frame.written_end, fragment_offset(info) + payload_len);
+        if (frame.fec) frame.fec_data_count[info.frag_index / frame.fec_block_len]++;
 
-        if (frame.received_count == frame.total_frags) {
+        // A frame spanning several blocks without parity: the sender stopped FEC
+        if (frame.received_count == frame.total_frags && !frame.fec && frame.total_frags > fec_block_len_) {
+            fec_block_len_ = 0;
+            fec_parity_count_ = 0;
+        }
+
+        if (frame.received_count == frame.total_frags && frame.in_target) {
+            res.complete = true;
+            res.in_target = true;
+            res.target_size = std::min(frame.final_data_size, frame.capacity);
+            target_data_ = nullptr;
+            target_capacity_ = 0;
+            target_in_use_ = false;
+            timer_unlink(frame);
+            release_fec(frame);
+            frame.received_mask.trim();
+            uncharge(frame);
+            frame.active = false;
+            frame.done = true;
+        } else if (frame.received_count == frame.total_frags) {
             // Trim the buffer to the exact size detected from the last fragment
             if (frame.final_data_size < frame.buffer.size()) {
                 frame.buffer.resize(frame.final_data_size);
             }
+            frame.buffer.shrink_to_fit();
 
             res.complete = true;
             res.data = std::move(frame.buffer);
-            pending_frames_.erase(it);
+            timer_unlink(frame);
+            release_fec(frame);
+            frame.received_mask.trim();
+            uncharge(frame);
+            frame.active = false;
+            frame.done = true;
         }
 
         return res;
     }
 
-private:
-    void cleanup_old_frames() {
-        auto now = std::chrono::steady_clock::now();
-        for (auto it = pending_frames_.begin(); it != pending_frames_.end(); ) {
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - it->second.last_update).count();
-            if (elapsed > FRAME_TIMEOUT_MS) it = pending_frames_.erase(it);
-            else ++it;
+    void erase_frame(IncompleteFrame& frame) {
+        timer_unlink(frame);
+        drop_frame(frame);
+    }
+
+    void drop_frame(IncompleteFrame& frame) {
+        // An evicted direct frame frees the target for the next frame
+        if (frame.in_target) target_in_use_ = false;
+        release_buffer(frame);
+        release_fec(frame);
+        frame.received_mask.trim();
+        uncharge(frame);
+        frame.active = false;
+        frame.done = false;
+    }
+
+    /**
+     * @brief Free the frame buffer, or keep it until end_commit() if slots of the current
+     * scatter batch point into it.
+     */
+    void release_buffer(IncompleteFrame& frame) {
+        if (pinned(frame) && frame.buffer.data() != nullptr) retired_.push_back(std::move(frame.buffer));
+        frame.buffer.reset();
+    }
+
+    bool pinned(const IncompleteFrame& frame) const { return batch_open_ && frame.slot_batch == batch_; }
+
+    void charge(IncompleteFrame& frame, size_t bytes) {
+        frame.charged += bytes;
+        pending_bytes_ += bytes;
+    }
+
+    /**
+     * @brief Give 'frame' an internal buffer of 'size' bytes, charged to the budget:
+     * a pool buffer, or a reserved mapping for large frames (nothing charged yet).
+     * @return false if it does not fit in the budget or cannot be allocated.
+     */
+    bool allocate_buffer(IncompleteFrame& frame, size_t size, bool may_evict) {
+        frame.lazy = size >= lazy_threshold_;
+        size_t cost = frame.lazy ? 0 : FrameBufferPool::class_size(size);
+        if (!make_room(cost, may_evict, &frame)) {
+            if (may_evict) rejected_frames_++;
+            return false;
+        }
+        try {
+            if (frame.lazy) {
+                frame.buffer = FrameBuffer::reserve(size);
+                frame.committed_chunks.reset((size + LAZY_CHUNK_SIZE - 1) / LAZY_CHUNK_SIZE);
+            } else {
+                frame.buffer = pool_->acquire(size);
+            }
+        } catch (const std::bad_alloc&) {
+            frame.buffer.reset();
+            return false;
+        }
+        frame.base = frame.buffer.data();
+        frame.capacity = frame.buffer.size();
+        frame.in_target = false;
+        charge(frame, cost);
+        frame.buffer_charged = cost;
+        return true;
+    }
+
+    /**
+     * @brief Large frame: commit (and charge) the chunks covering [offset, offset + len).
+     * @return false if a chunk does not fit in the budget or cannot be committed.
+     */
+    bool ensure_committed(IncompleteFrame& frame, size_t offset, size_t len, bool may_evict) {
+        if (len == 0) return true;
+        size_t last = (offset + len - 1) / LAZY_CHUNK_SIZE;
+        for (size_t chunk = offset / LAZY_CHUNK_SIZE; chunk <= last; ++chunk) {
+            if (frame.committed_chunks.test(chunk)) continue;
+
+            size_t start = chunk * LAZY_CHUNK_SIZE;
+            size_t bytes = frame.buffer.capacity() - start;
+            if (bytes > LAZY_CHUNK_SIZE) bytes = LAZY_CHUNK_SIZE;
+            if (!make_room(bytes, may_evict, &frame)) return false;
+            if (!frame.buffer.commit(start, bytes)) return false;
+            frame.committed_chunks.set(chunk);
+            charge(frame, bytes);
+            frame.buffer_charged += bytes;
         }
-        if (pending_frames_.size() >= MAX_PENDING_FRAMES) pending_frames_.erase(pending_frames_.begin());
+        return true;
+    }
+
+    void uncharge(IncompleteFrame& frame) {
+        pending_bytes_ -= frame.charged;
+        frame.charged = 0;
+        frame.buffer_charged = 0;
+    }
+
+    /**
+     * @brief Evict pending frames (per eviction_policy_, never 'keep' nor those with slots in the
+     * current scatter batch) until 'bytes' more fit in the budget.
+     * @return false if they cannot fit (nothing left to evict, or 'may_evict' is false).
+     */
+    bool make_room(size_t bytes, bool may_evict, const IncompleteFrame* keep) {
+        while (pending_bytes_ + bytes > memory_budget_) {
+            if (!may_evict) return false;
+            IncompleteFrame* victim = pick_victim(keep);
+            if (victim == nullptr) return false;
+            erase_frame(*victim);
+            evicted_frames_++;
+        }
+        return true;
+    }
+
+    IncompleteFrame* pick_victim(const IncompleteFrame* keep) {
+        IncompleteFrame* victim = nullptr;
+        for (auto& frame : slots_) {
+            if (!frame.active || frame.charged == 0 || &frame == keep || pinned(frame)) continue;
+            if (victim == nullptr) { victim = &frame; continue; }
+
+            bool better;
+            if (eviction_policy_ == EvictionPolicy::OLDEST_FIRST) {
+                better = (newest_id_ - frame.frame_id) > (newest_id_ - victim->frame_id);
+            } else {
+                // received / total, compared without division
+                better = static_cast<uint64_t>(frame.received_count) * victim->total_frags <
+                         static_cast<uint64_t>(victim->received_count) * frame.total_frags;
+            }
+            if (better) victim = &frame;
+        }
+        return victim;
+    }
+
+    uint64_t current_tick(std::chrono::steady_clock::time_point now) const {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+        return static_cast<uint64_t>(ms / tick_ms_);
+    }
+
+    /**
+     * @brief A fragment arrived for 'frame': its timeout starts over.
+     */
+    void touch(IncompleteFrame& frame) {
+        frame.expiry_tick = now_tick_ + timeout_ticks_;
+        last_activity_tick_ = now_tick_;
+        frame.last_fragment_us = now_us_;
+    }
+
+    uint32_t slot_index(const IncompleteFrame& frame) const {
+        return static_cast<uint32_t>(&frame - slots_.data());
+    }
+
+    void timer_link(IncompleteFrame& frame) {
+        uint32_t index = slot_index(frame);
+        uint32_t bucket = static_cast<uint32_t>(frame.expiry_tick % WHEEL_SIZE);
+        frame.timer_bucket = bucket;
+        frame.timer_prev = NO_SLOT;
+        frame.timer_next = wheel_[bucket];
+        if (wheel_[bucket] != NO_SLOT) slots_[wheel_[bucket]].timer_prev = index;
+        wheel_[bucket] = index;
+    }
+
+    void timer_unlink(IncompleteFrame& frame) {
+        if (frame.timer_prev != NO_SLOT) slots_[frame.timer_prev].timer_next = frame.timer_next;
+        else wheel_[frame.timer_bucket] = frame.timer_next;
+        if (frame.timer_next != NO_SLOT) slots_[frame.timer_next].timer_prev = frame.timer_prev;
+    }
+
+    /**
+     * @brief Visit the buckets of the ticks elapsed since the last call (all of them
+     * at most once): expired frames are dropped, the others move to their bucket.
+     */
+    void advance_wheel(std::chrono::steady_clock::time_point now) {
+        now_us_ = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+        uint64_t tick = current_tick(now);
+        if (tick <= now_tick_) return;
+
+        uint64_t steps = tick - now_tick_;
+        if (steps > WHEEL_SIZE) steps = WHEEL_SIZE;
+        now_tick_ = tick;
+
+        for (uint64_t s = 0; s < steps; ++s) {
+            uint32_t bucket = static_cast<uint32_t>((tick - s) % WHEEL_SIZE);
+            uint32_t index = wheel_[bucket];
+            wheel_[bucket] = NO_SLOT;
+            while (index != NO_SLOT) {
+                IncompleteFrame& frame = slots_[index];
+                index = frame.timer_next;
+                if (frame.expiry_tick <= tick) {
+                    drop_frame(frame);
+                    expired_frames_++;
+                } else {
+                    timer_link(frame);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Drop every pending frame. @return Number of frames dropped.
+     */
+    size_t flush() {
+        size_t count = 0;
+        for (auto& frame : slots_) {
+            if (!frame.active) continue;
+            erase_frame(frame);
+            count++;
+        }
+        return count;
     }
 };
 
+typedef BasicUdpReassembler<> UdpReassembler;
+
+/**
+ * @brief Reassembler of a stream whose payload size (and frame size) is known at compile time.
+ */
+template <size_t PayloadSize, size_t FrameSize = 0>
+using FixedUdpReassembler = BasicUdpReassembler<PayloadSize, FrameSize>;
+
 #endif // UDP_REASSEMBLER_HPP
\ No newline at end of file
@@ -1,7 +1,7 @@
 /**
  * @file UdpSink.hpp
  * @brief Streampu Sink module for high-performance UDP transmission.
- * * OPTIMIZATION: Uses sendmmsg (Linux) for batch transmission.
+ * * OPTIMIZATION: Uses sendmmsg (Linux) for batch transmission, or io_uring (TxMode::IO_URING).
  */
 
 #ifndef UDP_SINK_HPP
@@ -13,38 +13,531 @@
 
 #include "UdpSocket.hpp"
 #include "UdpPacketizer.hpp"
+#include "FixedUdpPacketizer.hpp"
+#include "IoUring.hpp"
+#include "XdpSocket.hpp"
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <ctime>
+#include <poll.h>
+#include <linux/errqueue.h>
+
+/**
+ * @brief Transmit path used by UdpSink::send_frame().
+ */
+enum class UdpTxMode {
+    SENDMMSG,   // One mmsghdr per fragment
+    GSO,        // UDP_SEGMENT: one mmsghdr per super-buffer of up to GSO_MAX_SEGMENTS fragments
+    IO_URING,   // Fragments staged in registered buffers, queued as linked SEND_ZC SQEs
+    XDP         // Kernel bypass (AF_XDP): Ethernet frames built in the UMEM, see set_xdp_interface()
+};
+
+/**
+ * @brief How UdpSink enforces a pacing rate (see UdpSink::set_pacing()).
+ */
+enum class UdpPacingMode {
+    AUTO,       // KERNEL if the default qdisc is fq, USER otherwise
+    KERNEL,     // SO_MAX_PACING_RATE: the fq qdisc spaces the datagrams out
+    USER        // Token bucket in send_frame(), plus SO_TXTIME launch times within a burst
+};
+
+/**
+ * @brief What UdpSink::send_frame() does with a frame the receiver has no credit for
+ * (see UdpSink::set_flow_control()).
+ */
+enum class UdpCreditPolicy {
+    BLOCK,      // Wait for credit (the frame is dropped after the timeout)
+    DROP        // Drop the frame right away
+};
+
+/**
+ * @brief Sink over a given packetizer: UdpPacketizer (UdpSink), or a FixedUdpPacketizer
+ * for streams whose payload size and frame size are known at compile time (FixedUdpSink).
+ */
+template <class Packetizer = UdpPacketizer>
+class BasicUdpSink {
+public:
+    typedef UdpTxMode TxMode;
+    typedef UdpPacingMode PacingMode;
+    typedef UdpCreditPolicy CreditPolicy;
 
-class UdpSink {
 private:
     UdpSocket socket_;
-    UdpPacketizer packetizer_;
+    Packetizer packetizer_;
     uint32_t frame_counter_ = 0;
+    TxMode tx_mode_ = TxMode::SENDMMSG;
+    size_t payload_size_ = 0;   // Requested payload size, 0: from the path MTU
 
     // Buffer for batch sending
     // We reuse this vector to avoid reallocating mmsghdr structs every frame
     std::vector<struct mmsghdr> msg_vec_;
 
+    // GSO Mode: the packetizer's (header, payload) iovec pairs laid out back to back,
+    // so that a super-buffer is a plain slice of this array (no payload copy).
+    std::vector<struct iovec> gso_iov_;
+
+    // Kernel limits: UDP_MAX_SEGMENTS and the 64 KB datagram size (minus IP/UDP headers)
+    static const size_t GSO_MAX_SEGMENTS = 64;
+    static const size_t GSO_MAX_BYTES = 65507;
+
+    // With MSG_ZEROCOPY every iovec becomes (at least) one skb page fragment and an skb holds
+    // at most MAX_SKB_FRAGS (17): header + payload per segment, payloads may straddle a page.
+    static const size_t GSO_ZEROCOPY_MAX_SEGMENTS = 5;
+
+    // Likewise a single datagram: header + a payload straddling at most 16 pages (larger: EMSGSIZE)
+    static const size_t ZEROCOPY_MAX_PAYLOAD = 15 * 4096;
+
+    // Zero-Copy Mode (MSG_ZEROCOPY): the kernel pins the user pages instead of copying them.
+    // Each successful send gets the next notification id; the error queue reports id ranges
+    // once the kernel has released the pages.
+    struct InFlightFrame {
+        const void* data;
+        uint32_t last_id;
+    };
+    bool zerocopy_ = false;
+    uint32_t zc_next_id_ = 0;               // Id of the next zerocopy send
+    uint32_t zc_base_ = 0;                  // Oldest id not completed yet
+    std::deque<bool> zc_done_;              // Completion flags for ids [zc_base_, zc_next_id_)
+    std::deque<InFlightFrame> in_flight_;
+    size_t zc_copied_ = 0;                  // Completions where the kernel fell back to a copy
+
+    // io_uring Mode: each fragment (header + payload) is copied into a slot of a registered
+    // staging arena and sent from there, so the caller's buffer is free as soon as
+    // send_frame() returns. A slot is reused once the kernel has posted its last CQE
+    // (the SEND_ZC notification). The arena is declared first: it must outlive the ring.
+    // Slots hold a whole datagram of the current payload size; their number follows
+    // from the arena size.
+    static const size_t URING_ARENA_BYTES = size_t(8) << 20;
+    static const unsigned URING_MIN_SLOTS = 64;
+    static const unsigned URING_MAX_SLOTS = 4096;
+    static const unsigned URING_SQ_ENTRIES = 256;
+    size_t uring_slot_size_ = 0;
+    unsigned uring_slot_count_ = 0;
+    std::vector<uint8_t> uring_arena_;
+    std::vector<struct msghdr> uring_msgs_;     // SENDMSG fallback (kernel without SEND_ZC)
+    std::vector<struct iovec> uring_iovs_;
+    std::vector<bool> uring_busy_;              // Slot still referenced by the kernel
+    std::unique_ptr<IoUring> uring_;
+    unsigned uring_next_slot_ = 0;
+    size_t uring_pending_ = 0;                  // Busy slots
+    bool uring_send_zc_ = false;
+    bool uring_fixed_ = false;                  // Arena registered (IORING_RECVSEND_FIXED_BUF)
+    bool uring_report_usage_ = true;            // IORING_SEND_ZC_REPORT_USAGE (Linux >= 6.2)
+    size_t uring_errors_ = 0;
+
+    // SEND_ZC is dropped for plain sends once this many notifications all reported a copy
+    // (loopback or no scatter-gather: pinning pages then only costs).
+    static const size_t URING_ZC_PROBE_NOTIFS = 256;
+    size_t uring_zc_notifs_ = 0;
+    size_t uring_zc_copied_ = 0;
+
+    // XDP Mode: complete Ethernet/IPv4/UDP frames are written into the UMEM of an AF_XDP
+    // socket and sent from there (no qdisc, no socket layer). UDP source port = dest port.
+    static const unsigned XDP_TX_FRAMES = 4096;
+    static const uint32_t XDP_FRAME_SIZE = 2048;   // UMEM chunk: bounds the payload size
+    std::string xdp_ifname_;
+    unsigned xdp_queue_ = 0;
+    uint8_t xdp_src_mac_[6];
+    uint8_t xdp_dst_mac_[6];
+    uint32_t xdp_src_ip_ = 0;           // Network order
+    uint16_t xdp_ip_id_ = 0;
+    std::unique_ptr<XdpSocket> xsk_;
+
+    // Retransmission: a copy of each of the last frames (slot frame_id % count), resent
+    // fragment by fragment when a NACK comes in on the feedback socket. The copies are
+    // fragmented again by a plain UdpPacketizer with the geometry they were sent with,
+    // and resent from the feedback socket (no GSO segment size, no MSG_ZEROCOPY).
+    struct RetainedFrame {
+        bool valid = false;
+        uint32_t frame_id;
+        std::vector<uint8_t> data;
+        size_t payload_size;
+        uint8_t version;
+    };
+    std::vector<RetainedFrame> retained_;
+    std::mutex retx_mutex_;                     // retained_, retx_packetizer_
+    UdpPacketizer retx_packetizer_;
+    bool retx_prepared_ = false;                // retx_packetizer_ holds retx_prepared_id_
+    uint32_t retx_prepared_id_ = 0;
+    std::vector<struct mmsghdr> retx_msgs_;
+    std::unique_ptr<UdpSocket> feedback_socket_;    // Shared with flow control
+    uint16_t feedback_port_ = 0;
+    std::thread feedback_thread_;
+    std::atomic<bool> feedback_running_{false};
+    std::atomic<size_t> nacks_received_{0};
+    std::atomic<size_t> retransmitted_fragments_{0};
+
+    // Pacing: frames leave at pacing_rate_ (bytes per second on the wire, IP/UDP headers
+    // included), or each spread over pacing_spread_us_. USER mode releases them in bursts
+    // of up to pacing_burst_ bytes from a token bucket: pacing_next_ns_ is when the bucket
+    // is full again (CLOCK_MONOTONIC). Within a burst, SO_TXTIME launch times (sendmmsg and
+    // GSO paths) let an fq/etf qdisc space the datagrams; any other qdisc sends them at once.
+    static const uint64_t PACING_BURST_NS = 1000000;   // Default burst: 1 ms at the pacing rate
+    PacingMode pacing_mode_ = PacingMode::USER;
+    uint64_t pacing_rate_ = 0;                  // 0: no pacing (or per frame, see pacing_spread_us_)
+    unsigned pacing_spread_us_ = 0;
+    size_t pacing_burst_request_ = 0;           // 0: PACING_BURST_NS worth of bytes
+    size_t pacing_burst_ = 0;
+    uint64_t pacing_next_ns_ = 0;
+    uint64_t kernel_pacing_rate_ = 0;           // Last SO_MAX_PACING_RATE set, 0: none
+    bool txtime_ = false;                       // SO_TXTIME accepted by the socket
+    uint64_t txtime_launch_ns_ = 0;             // Launch time of the burst being sent
+    double txtime_ns_per_byte_ = 0;
+    std::vector<uint64_t> txtime_control_;      // One SCM_TXTIME control message per mmsghdr
+    static const size_t TXTIME_CONTROL_WORDS = (CMSG_SPACE(sizeof(uint64_t)) + 7) / 8;
+
+    // Flow control: the receiver's latest grant (see SpuCreditHeader), received on the
+    // feedback socket, and the frames sent since its base (ID, size) for the byte count.
+    bool credit_enabled_ = false;
+    CreditPolicy credit_policy_ = CreditPolicy::BLOCK;
+    int credit_timeout_ms_ = 1000;
+    std::mutex credit_mutex_;                   // Everything below but credit_dropped_
+    std::condition_variable credit_cv_;
+    bool credit_valid_ = false;                 // A grant arrived
+    bool credit_rebase_ = false;                // SPU_UDP_CREDIT_FLAG_ANY_BASE: base = next frame sent
+    uint32_t credit_session_ = 0;
+    uint32_t credit_seq_ = 0;
+    uint32_t credit_base_ = 0;
+    uint32_t credit_frames_ = 0;
+    uint64_t credit_bytes_ = 0;
+    std::deque<std::pair<uint32_t, size_t>> credit_sent_;
+    uint64_t credit_sent_bytes_ = 0;
+    size_t credit_dropped_ = 0;
+
 public:
-    UdpSink(const std::string& dest_ip, uint16_t dest_port) {
+    BasicUdpSink(const std::string& dest_ip, uint16_t dest_port) {
         socket_.set_destination(dest_ip, dest_port);
         // Pre-allocate enough headers for a large frame (e.g. 8000 packets)
         msg_vec_.reserve(8000);
+        apply_payload_size();
+    }
+
+    ~BasicUdpSink() {
+        stop_feedback();
+        if (uring_) wait_all_sent();
+    }
+
+    /**
+     * @brief Select the transmit path.
+     * GSO falls back to SENDMMSG if the kernel refuses UDP_SEGMENT, IO_URING if
+     * io_uring is unavailable.
+     */
+    void set_tx_mode(TxMode mode) {
+        if (mode == TxMode::GSO && !socket_.set_gso_segment(static_cast<int>(gso_segment_size()))) {
+            std::cerr << "[WARNING] UdpSink: UDP_SEGMENT not supported, using sendmmsg" << std::endl;
+            mode = TxMode::SENDMMSG;
+        }
+        if (mode == TxMode::IO_URING && !init_uring()) mode = TxMode::SENDMMSG;
+        if (mode == TxMode::XDP && !init_xdp()) mode = TxMode::SENDMMSG;
+        if (mode != TxMode::GSO && tx_mode_ == TxMode::GSO) socket_.set_gso_segment(0);
+        if (mode != TxMode::IO_URING && tx_mode_ == TxMode::IO_URING) wait_all_sent();
+        bool xdp_changed = (mode == TxMode::XDP) != (tx_mode_ == TxMode::XDP);
+        tx_mode_ = mode;
+        if (xdp_changed) apply_payload_size(); // The UMEM frame bounds the payload
+    }
+
+    TxMode get_tx_mode() const { return tx_mode_; }
+
+    /**
+     * @brief Protocol version of the fragment headers: SPU_UDP_VERSION_1 (default) or
+     * SPU_UDP_VERSION_2, which lets the receiver allocate the exact frame size up front.
+     * Every UdpSource understands both. v1 is only possible with SPU_UDP_MAX_PAYLOAD
+     * byte payloads: other sizes (e.g. from the path MTU) are sent as v2 regardless.
+     */
+    void set_protocol_version(uint8_t version) {
+        if (zerocopy_) wait_all_released(); // Headers of the previous frame may still be pinned
+        packetizer_.set_protocol_version(version);
+        if (tx_mode_ == TxMode::GSO && !socket_.set_gso_segment(static_cast<int>(gso_segment_size())))
+            set_tx_mode(TxMode::SENDMMSG);
+    }
+
+    uint8_t get_protocol_version() const { return packetizer_.get_protocol_version(); }
+
+    /**
+     * @brief Forward error correction: 'parity_count' parity fragments after every
+     * 'block_len' data fragments (see UdpPacketizer::set_fec()), 0 to disable (default).
+     * The receiver rebuilds up to 'parity_count' lost fragments per block, with no round
+     * trip; UdpSources older than FEC ignore the parity fragments.
+     */
+    void set_fec(unsigned block_len, unsigned parity_count) {
+        if (zerocopy_) wait_all_released(); // Parity payloads of the previous frame may still be pinned
+        packetizer_.set_fec(block_len, parity_count);
+        if (tx_mode_ == TxMode::GSO && !socket_.set_gso_segment(static_cast<int>(gso_segment_size())))
+            set_tx_mode(TxMode::SENDMMSG);
+    }
+
+    /**
+     * @brief Retransmission (ARQ): keep a copy of the last 'frames' frames and resend the
+     * fragments a UdpSource reports missing (see UdpSource::set_nack()), which it sends to
+     * 'feedback_port' on this host. Costs a copy of each frame, and bandwidth in
+     * proportion to the actual loss. 'frames' = 0 disables it (default).
+     * @throws std::runtime_error if 'feedback_port' cannot be bound.
+     */
+    void set_retransmission(size_t frames, uint16_t feedback_port) {
+        {
+            std::lock_guard<std::mutex> lock(retx_mutex_);
+            retained_.clear();
+            retained_.resize(frames);
+            retx_prepared_ = false;
+        }
+        update_feedback(frames > 0 ? feedback_port : feedback_port_);
+    }
+
+    /**
+     * @brief Retransmission: NACKs received, and fragments resent for them.
+     */
+    size_t get_nacks_received() const { return nacks_received_.load(); }
+    size_t get_retransmitted_fragments() const { return retransmitted_fragments_.load(); }
+
+    /**
+     * @brief Flow control: only send the frames a UdpSource has room for (see
+     * UdpSource::set_flow_control()), which grants credit to 'feedback_port' on this host
+     * (the port set_retransmission() uses, if both are on). Without credit, send_frame()
+     * waits for it (BLOCK, up to 'timeout_ms', < 0: forever) or drops the frame (DROP),
+     * before fragmenting it: an overloaded receiver then costs nothing on the wire, and
+     * a dropped frame uses up no frame ID. Nothing is sent until the first grant arrives.
+     * 'feedback_port' = 0 disables it (default).
+     * @throws std::runtime_error if 'feedback_port' cannot be bound.
+     */
+    void set_flow_control(uint16_t feedback_port, CreditPolicy policy = CreditPolicy::BLOCK, int timeout_ms = 1000) {
+        {
+            std::lock_guard<std::mutex> lock(credit_mutex_);
+            credit_enabled_ = feedback_port != 0;
+            credit_policy_ = policy;
+            credit_timeout_ms_ = timeout_ms;
+            credit_valid_ = false;
+            credit_sent_.clear();
+            credit_sent_bytes_ = 0;
+        }
+        update_feedback(feedback_port != 0 ? feedback_port : feedback_port_);
+    }
+
+    /**
+     * @brief Flow control: frames dropped for lack of credit.
+     */
+    size_t get_credit_dropped_frames() const { return credit_dropped_; }
+
+    /**
+     * @brief Pace the transmission at 'bits_per_second' on the wire (IP and UDP headers
+     * included) instead of sending each frame in one burst, which overflows the receiver's
+     * socket buffer and switch queues at frame boundaries. 0 disables it (default).
+     * KERNEL leaves it to the fq qdisc (SO_MAX_PACING_RATE), at no CPU cost; AUTO picks it
+     * when fq is the default qdisc, which is all that can be checked without netlink.
+     * USER sleeps in send_frame() between bursts of 'burst_bytes' (0: 1 ms worth, at least
+     * one datagram), whose datagrams carry SO_TXTIME launch times honoured by fq and etf.
+     * The XDP path has no qdisc: it is always paced by USER, without launch times.
+     */
+    void set_pacing(uint64_t bits_per_second, PacingMode mode = PacingMode::AUTO, size_t burst_bytes = 0) {
+        pacing_rate_ = bits_per_second / 8;
+        pacing_spread_us_ = 0;
+        apply_pacing(mode, burst_bytes);
+    }
+
+    /**
+     * @brief Pace each frame over 'interval_us' (e.g. the frame period of the stream):
+     * the rate follows from the frame's wire size, see set_pacing(). 0 disables it.
+     * A frame sent before the previous one is out waits for it.
+     */
+    void set_frame_pacing(unsigned interval_us, PacingMode mode = PacingMode::AUTO, size_t burst_bytes = 0) {
+        pacing_rate_ = 0;
+        pacing_spread_us_ = interval_us;
+        apply_pacing(mode, burst_bytes);
+    }
+
+    /**
+     * @brief Pacing mode in effect (AUTO resolved).
+     */
+    PacingMode get_pacing_mode() const { return pacing_mode_; }
+
+    /**
+     * @brief Payload bytes per fragment. 0 (default): derived from the path MTU (IP_MTU
+     * towards the destination minus the IP, UDP and v2 headers), SPU_UDP_MAX_PAYLOAD
+     * if it cannot be queried. Loopback (64 KB MTU) and jumbo-frame networks then need
+     * far fewer packets per frame.
+     * Clamped to the largest UDP datagram, to what MSG_ZEROCOPY accepts, and to the
+     * UMEM frame in XDP mode. Any size
+     * but SPU_UDP_MAX_PAYLOAD is sent with v2 headers, which every UdpSource accepts
+     * (set SPU_UDP_MAX_PAYLOAD to talk to v1-only receivers).
+     * A FixedUdpPacketizer keeps its own size: a path that cannot carry it is left
+     * instead (XDP for sendmmsg, MSG_ZEROCOPY for copies).
+     * @throws std::invalid_argument if the packetizer's payload size is fixed to another one.
+     */
+    void set_payload_size(size_t bytes) {
+        if (Packetizer::FIXED_PAYLOAD && bytes != 0) packetizer_.set_payload_size(bytes);
+        payload_size_ = bytes;
+        apply_payload_size();
+    }
+
+    size_t get_payload_size() const { return packetizer_.get_payload_size(); }
+
+    /**
+     * @brief XDP Mode: where to send from. Call before set_tx_mode(TxMode::XDP).
+     * The destination IP/port are the sink's; the next hop MAC must be given (no ARP).
+     * @param dst_mac Next hop MAC address ("aa:bb:cc:dd:ee:ff").
+     * @param src_ip Source IPv4 address (empty: the interface's address).
+     * @return false if an argument is malformed.
+     */
+    bool set_xdp_interface(const std::string& ifname, const std::string& dst_mac,
+                           const std::string& src_ip = "", unsigned queue = 0) {
+        if (!XdpSocket::parse_mac(dst_mac, xdp_dst_mac_)) return false;
+        if (!src_ip.empty() && inet_pton(AF_INET, src_ip.c_str(), &xdp_src_ip_) != 1) return false;
+        if (src_ip.empty()) xdp_src_ip_ = 0;
+        xdp_ifname_ = ifname;
+        xdp_queue_ = queue;
+        return true;
+    }
+
+    /**
+     * @brief Zero-Copy Mode: send with MSG_ZEROCOPY (best combined with GSO: large sends).
+     *
+     * The frame buffer must not be modified until the kernel releases it: see
+     * is_released() / wait_released(). The packet headers are reused from one
+     * frame to the next, so send_frame() first waits for the previous frame.
+     */
+    void set_zerocopy(bool enable) {
+        if (enable && !zerocopy_ && !socket_.enable_zerocopy()) {
+            std::cerr << "[WARNING] UdpSink: SO_ZEROCOPY not supported, payloads will be copied" << std::endl;
+            return;
+        }
+        if (!enable) wait_all_released();
+        zerocopy_ = enable;
+        apply_payload_size();
+    }
+
+    bool get_zerocopy() const { return zerocopy_; }
+
+    /**
+     * @brief Zero-Copy Mode: true once the kernel no longer references 'data'.
+     */
+    bool is_released(const void* data) {
+        reap_completions(0);
+        for (const auto& frame : in_flight_)
+            if (frame.data == data) return false;
+        return true;
+    }
+
+    /**
+     * @brief Zero-Copy Mode: block until the kernel releases 'data'.
+     */
+    void wait_released(const void* data) {
+        while (!is_released(data)) reap_completions(100);
+    }
+
+    /**
+     * @brief Zero-Copy Mode: block until every frame sent so far is released.
+     */
+    void wait_all_released() {
+        reap_completions(0);
+        while (!in_flight_.empty()) reap_completions(100);
     }
 
+    /**
+     * @brief Zero-Copy Mode: number of sends the kernel ended up copying anyway
+     * (e.g. loopback, or a device without scatter-gather).
+     */
+    size_t get_zerocopy_copied() const { return zc_copied_; }
+
+    /**
+     * @brief io_uring Mode: block until every queued fragment has left (and its slot is free).
+     */
+    void wait_all_sent() {
+        while (uring_pending_ > 0 && reap_uring(true)) {}
+    }
+
+    /**
+     * @brief io_uring Mode: fragments whose send completed with an error (or was cancelled
+     * because an earlier fragment of its chain failed), or that a failing ring could not
+     * queue (those are resent with sendmmsg, which the sink then keeps using).
+     */
+    size_t get_send_errors() const { return uring_errors_; }
+
     /**
      * @brief Sends a full frame to the network using batching.
      * @param data Pointer to the raw data buffer.
      * @param size Size of the data in bytes.
      */
     void send_frame(const void* data, size_t size) {
+        // The headers of the previous frame may still be pinned by the kernel
+        if (zerocopy_) wait_all_released();
+
+        if (credit_enabled_ && !acquire_credit(size)) {
+            credit_dropped_++;
+            return;
+        }
+
         // 1. Fragment the data (Zero-Copy)
         size_t packet_count = packetizer_.prepare_frame(data, size, frame_counter_++);
+        uint32_t first_id = zc_next_id_;
+        if (!retained_.empty()) retain(data, size, frame_counter_ - 1);
+
+        if (pacing_spread_us_ > 0) set_frame_rate(packet_count);
+        if (pacing_rate_ > 0 && user_pacing()) {
+            // Token bucket: one burst of consecutive fragments at a time
+            const auto* packets = packetizer_.get_packets();
+            for (size_t first = 0; first < packet_count;) {
+                size_t last = first;
+                size_t bytes = wire_size(packets[last++]);
+                while (last < packet_count && bytes + wire_size(packets[last]) <= pacing_burst_)
+                    bytes += wire_size(packets[last++]);
+                pace(bytes);
+                transmit(first, last);
+                first = last;
+            }
+        } else {
+            transmit(0, packet_count);
+        }
 
+        if (zc_next_id_ != first_id) {
+            InFlightFrame frame = {data, zc_next_id_ - 1};
+            in_flight_.push_back(frame);
+        }
+    }
+
+private:
+    /**
+     * @brief Send packets [first, last) of the prepared frame on the current path.
+     */
+    void transmit(size_t first, size_t last) {
+        if (tx_mode_ == TxMode::GSO) {
+            size_t sent = send_packets_gso(first, last);
+            if (sent != last) {
+                // Kernel/device refused the super-buffers: resend the rest one datagram each
+                set_tx_mode(TxMode::SENDMMSG);
+                send_packets(sent, last);
+            }
+        } else if (tx_mode_ == TxMode::IO_URING) {
+            size_t queued = send_packets_uring(first, last);
+            if (queued != last) {
+                // The ring failed: the rest is counted as errors and resent one datagram each
+                std::cerr << "[WARNING] UdpSink: io_uring failed, using sendmmsg" << std::endl;
+                uring_errors_ += last - queued;
+                set_tx_mode(TxMode::SENDMMSG);
+                send_packets(queued, last);
+            }
+        } else if (tx_mode_ == TxMode::XDP) {
+            send_packets_xdp(first, last);
+        } else {
+            send_packets(first, last);
+        }
+    }
+
+    /**
+     * @brief Send packets [first, last) of the prepared frame, one mmsghdr each.
+     */
+    void send_packets(size_t first, size_t last) {
         const auto* packets = packetizer_.get_packets();
         int sockfd = socket_.get_fd();
         const auto* dest = socket_.get_dest_addr();
+        size_t packet_count = last;
 
         // 2. Prepare Batch Structures (Zero-Copy)
         // We only need to resize the vector of headers, not reallocate the payloads
@@ -53,7 +546,7 @@ public:
         }
 
         // We fill the mmsghdr structures pointing to the packetizer's iovecs
-        for (size_t i = 0; i < packet_count; ++i) {
+        for (size_t i = first; i < packet_count; ++i) {
             auto& msg_hdr = msg_vec_[i].msg_hdr;
 
             // Point to the packetizer's scatter/gather array
@@ -70,16 +563,28 @@ public:
             msg_hdr.msg_controllen = 0;
             msg_hdr.msg_flags = 0;
         }
+        if (txtime_launch_ns_ != 0) {
+            size_t bytes = 0;
+            for (size_t i = first; i < packet_count; ++i) {
+                set_launch_time(msg_vec_[i].msg_hdr, i, bytes);
+                bytes += wire_size(packets[i]);
+            }
+        }
 
         // 3. Batch Send Loop
         // sendmmsg can handle the whole batch, but sometimes returns partials.
-        size_t sent_packets = 0;
+        size_t sent_packets = first;
         while (sent_packets < packet_count) {
             // Send remaining packets in one syscall
-            int retval = sendmmsg(sockfd, &msg_vec_[sent_packets], packet_count - sent_packets, 0);
+            int retval = sendmmsg(sockfd, &msg_vec_[sent_packets], packet_count - sent_packets, send_flags());
 
             if (retval < 0) {
                 if (errno == EINTR) continue;
+                // Zero-Copy Mode: out of optmem for notifications, wait for some and drain them
+                if (errno == ENOBUFS && zerocopy_ && !zc_done_.empty()) {
+                    reap_completions(10);
+                    continue;
+                }
                 // If buffer is full (EAGAIN), we might want to yield or retry
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     // Simple busy-wait/yield strategy for low latency
@@ -91,8 +596,702 @@ public:
             }
 
             sent_packets += retval;
+            issued(retval);
+        }
+    }
+
+    /**
+     * @brief GSO Mode: send packets [first_packet, last) of the prepared frame as
+     * super-buffers of consecutive fragments. Every fragment but the frame's last is exactly
+     * gso_segment_size() bytes on the wire, which is what UDP_SEGMENT requires.
+     * @return End of the fragments handed to the kernel ('last' unless GSO was refused).
+     */
+    size_t send_packets_gso(size_t first_packet, size_t last) {
+        const auto* packets = packetizer_.get_packets();
+        int sockfd = socket_.get_fd();
+        const auto* dest = socket_.get_dest_addr();
+
+        const size_t segment = gso_segment_size();
+        size_t per_msg = GSO_MAX_BYTES / segment;
+        if (per_msg > GSO_MAX_SEGMENTS) per_msg = GSO_MAX_SEGMENTS;
+        if (zerocopy_ && per_msg > GSO_ZEROCOPY_MAX_SEGMENTS) per_msg = GSO_ZEROCOPY_MAX_SEGMENTS;
+
+        if (gso_iov_.size() < 2 * last) gso_iov_.resize(2 * last);
+        if (msg_vec_.size() < last) msg_vec_.resize(last);
+
+        for (size_t i = first_packet; i < last; ++i) {
+            gso_iov_[2 * i] = packets[i].iov[0];
+            gso_iov_[2 * i + 1] = packets[i].iov[1];
+        }
+
+        // Only the last segment of a super-buffer may be short: the frame's last data
+        // fragment ends one (FEC parity fragments may follow it)
+        size_t msg_count = 0;
+        size_t bytes = 0;
+        for (size_t first = first_packet; first < last; msg_count++) {
+            auto& msg_hdr = msg_vec_[msg_count].msg_hdr;
+            msg_hdr.msg_control = nullptr;
+            msg_hdr.msg_controllen = 0;
+            if (txtime_launch_ns_ != 0) set_launch_time(msg_hdr, msg_count, bytes);
+
+            size_t n = 0;
+            while (n < per_msg && first + n < last) {
+                const auto& p = packets[first + n++];
+                bytes += wire_size(p);
+                if (p.iov[0].iov_len + p.iov[1].iov_len < segment) break;
+            }
+            msg_hdr.msg_iov = &gso_iov_[2 * first];
+            msg_hdr.msg_iovlen = 2 * n;
+            msg_hdr.msg_name = (void*)dest;
+            msg_hdr.msg_namelen = sizeof(*dest);
+            msg_hdr.msg_flags = 0;
+            first += n;
+        }
+
+        size_t sent_msgs = 0;
+        while (sent_msgs < msg_count) {
+            int retval = sendmmsg(sockfd, &msg_vec_[sent_msgs], msg_count - sent_msgs, send_flags());
+
+            if (retval < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) continue;
+                if (errno == ENOBUFS && zerocopy_ && !zc_done_.empty()) {
+                    reap_completions(10);
+                    continue;
+                }
+                // EIO/EINVAL: the route/device cannot segment (e.g. no checksum offload)
+                perror("UdpSink: GSO sendmmsg failed");
+                size_t sent = first_packet;
+                for (size_t m = 0; m < sent_msgs; ++m) sent += msg_vec_[m].msg_hdr.msg_iovlen / 2;
+                return sent;
+            }
+            sent_msgs += retval;
+            issued(retval);
+        }
+        return last;
+    }
+
+    /**
+     * @brief io_uring Mode: queue packets [first, last) of the prepared frame, one linked
+     * SQE per fragment, and return once everything is submitted. Only blocks when the
+     * staging arena is full. Links keep a frame's fragments in order; a chain ends at each
+     * submission (and at 'last').
+     * @return End of the fragments queued ('last' unless io_uring_enter failed).
+     */
+    size_t send_packets_uring(size_t first, size_t last) {
+        const auto* packets = packetizer_.get_packets();
+        const auto* dest = socket_.get_dest_addr();
+        int sockfd = socket_.get_fd();
+
+        reap_uring(false);
+        for (size_t i = first; i < last; ++i) {
+            unsigned slot = uring_next_slot_;
+            struct io_uring_sqe* sqe = nullptr;
+            while (uring_busy_[slot] || (sqe = uring_->get_sqe()) == nullptr) {
+                if (!reap_uring(true)) return i;
+            }
+
+            uint8_t* buf = &uring_arena_[slot * uring_slot_size_];
+            size_t header_len = packets[i].iov[0].iov_len;
+            size_t payload_len = packets[i].iov[1].iov_len;
+            std::memcpy(buf, packets[i].iov[0].iov_base, header_len);
+            std::memcpy(buf + header_len, packets[i].iov[1].iov_base, payload_len);
+            size_t len = header_len + payload_len;
+
+            if (uring_send_zc_) {
+                sqe->opcode = IORING_OP_SEND_ZC;
+                sqe->addr = reinterpret_cast<uint64_t>(buf);
+                sqe->len = static_cast<uint32_t>(len);
+                sqe->addr2 = reinterpret_cast<uint64_t>(dest);
+                sqe->addr_len = sizeof(*dest);
+                if (uring_fixed_) {
+                    sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+                    sqe->buf_index = 0;
+                }
+                if (uring_report_usage_) sqe->ioprio |= IORING_SEND_ZC_REPORT_USAGE;
+            } else {
+                uring_iovs_[slot].iov_len = len;
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->addr = reinterpret_cast<uint64_t>(&uring_msgs_[slot]);
+                sqe->len = 1;
+            }
+            sqe->fd = sockfd;
+            sqe->user_data = slot;
+            if (i + 1 < last) sqe->flags = IOSQE_IO_LINK;
+
+            uring_busy_[slot] = true;
+            uring_pending_++;
+            uring_next_slot_ = (slot + 1) % uring_slot_count_;
+        }
+        reap_uring(false); // Submit the rest
+        return last;
+    }
+
+    /**
+     * @brief io_uring Mode: submit pending SQEs and collect completions.
+     * @param wait Wait (up to 100 ms) for at least one completion.
+     * @return false on a fatal io_uring error.
+     */
+    bool reap_uring(bool wait) {
+        int ret = uring_->submit(wait ? 1 : 0, 100);
+        if (ret < 0 && ret != -ETIME && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            errno = -ret;
+            perror("UdpSink: io_uring_enter failed");
+            return false;
+        }
+
+        struct io_uring_cqe* cqe;
+        while ((cqe = uring_->peek_cqe()) != nullptr) {
+            unsigned slot = static_cast<unsigned>(cqe->user_data);
+            if (cqe->flags & IORING_CQE_F_NOTIF) {
+                uring_zc_notifs_++;
+                if (static_cast<uint32_t>(cqe->res) & IORING_NOTIF_USAGE_ZC_COPIED) uring_zc_copied_++;
+            } else if (cqe->res < 0) {
+                uring_errors_++;
+                // Kernel without usage reports rejects the flag: stop asking
+                if (cqe->res == -EINVAL && uring_send_zc_ && uring_report_usage_) uring_report_usage_ = false;
+            }
+            // SEND_ZC posts the send result with F_MORE, then a notification once the
+            // buffer is released: the slot is free after the last one.
+            if ((cqe->flags & IORING_CQE_F_MORE) == 0 && uring_busy_[slot]) {
+                uring_busy_[slot] = false;
+                uring_pending_--;
+            }
+            uring_->cq_advance();
+        }
+
+        if (uring_send_zc_ && uring_report_usage_ && uring_zc_notifs_ >= URING_ZC_PROBE_NOTIFS) {
+            if (uring_zc_copied_ == uring_zc_notifs_) {
+                std::cerr << "[WARNING] UdpSink: SEND_ZC payloads are copied by the kernel (loopback?), "
+                          << "using plain io_uring sends" << std::endl;
+                init_uring_sendmsg();
+            }
+            uring_report_usage_ = false; // Decided
+        }
+        return true;
+    }
+
+    /**
+     * @brief io_uring Mode: create the ring and the staging arena (once).
+     * @return false (with a warning) if io_uring cannot be used.
+     */
+    bool init_uring() {
+        if (uring_) return true;
+        std::unique_ptr<IoUring> ring;
+        try {
+            ring.reset(new IoUring(URING_SQ_ENTRIES, 2 * URING_MAX_SLOTS));
+        } catch (const std::runtime_error& e) {
+            std::cerr << "[WARNING] UdpSink: " << e.what() << ", using sendmmsg" << std::endl;
+            return false;
+        }
+        if ((ring->get_features() & IORING_FEAT_EXT_ARG) == 0) {
+            std::cerr << "[WARNING] UdpSink: io_uring too old (no EXT_ARG), using sendmmsg" << std::endl;
+            return false;
+        }
+
+        uring_slot_size_ = SPU_UDP_V2_HEADER_SIZE + packetizer_.get_payload_size();
+        size_t count = URING_ARENA_BYTES / uring_slot_size_;
+        if (count < URING_MIN_SLOTS) count = URING_MIN_SLOTS;
+        if (count > URING_MAX_SLOTS) count = URING_MAX_SLOTS;
+        uring_slot_count_ = static_cast<unsigned>(count);
+        uring_next_slot_ = 0;
+        uring_pending_ = 0;
+
+        uring_arena_.assign(uring_slot_count_ * uring_slot_size_, 0);
+        uring_busy_.assign(uring_slot_count_, false);
+        uring_send_zc_ = ring->probe_opcode(IORING_OP_SEND_ZC);
+        if (uring_send_zc_) {
+            struct iovec arena;
+            arena.iov_base = uring_arena_.data();
+            arena.iov_len = uring_arena_.size();
+            uring_fixed_ = ring->register_buffers(&arena, 1) == 0;
+            if (!uring_fixed_)
+                std::cerr << "[WARNING] UdpSink: cannot register the io_uring staging buffers "
+                          << "(RLIMIT_MEMLOCK?), pages will be pinned on every send" << std::endl;
+        } else {
+            init_uring_sendmsg();
+        }
+        uring_ = std::move(ring);
+        return true;
+    }
+
+    /**
+     * @brief io_uring Mode: switch to IORING_OP_SENDMSG (plain sends only take a destination
+     * address since SEND_ZC), with one msghdr per slot.
+     */
+    void init_uring_sendmsg() {
+        const auto* dest = socket_.get_dest_addr();
+        uring_msgs_.resize(uring_slot_count_);
+        uring_iovs_.resize(uring_slot_count_);
+        for (unsigned i = 0; i < uring_slot_count_; ++i) {
+            uring_iovs_[i].iov_base = &uring_arena_[i * uring_slot_size_];
+            uring_iovs_[i].iov_len = uring_slot_size_;
+            std::memset(&uring_msgs_[i], 0, sizeof(struct msghdr));
+            uring_msgs_[i].msg_name = (void*)dest;
+            uring_msgs_[i].msg_namelen = sizeof(*dest);
+            uring_msgs_[i].msg_iov = &uring_iovs_[i];
+            uring_msgs_[i].msg_iovlen = 1;
+        }
+        uring_send_zc_ = false;
+    }
+
+    /**
+     * @brief XDP Mode: build one Ethernet frame per fragment [first, last) in the UMEM and
+     * kick the kernel. The payload is copied, so 'data' is free when send_frame() returns.
+     */
+    void send_packets_xdp(size_t first, size_t last) {
+        const auto* packets = packetizer_.get_packets();
+        const auto* dest = socket_.get_dest_addr();
+
+        for (size_t i = first; i < last; ++i) {
+            uint8_t* frame;
+            while ((frame = xsk_->tx_frame()) == nullptr) {
+                if (!xsk_->kick()) return; // UMEM exhausted: send what is queued first
+            }
+            size_t header_len = packets[i].iov[0].iov_len;
+            size_t payload_len = packets[i].iov[1].iov_len;
+            size_t udp_payload = header_len + payload_len;
+            EthIpv4Udp::build(frame, xdp_src_mac_, xdp_dst_mac_, xdp_src_ip_, dest->sin_addr.s_addr,
+                              dest->sin_port, dest->sin_port, xdp_ip_id_++, udp_payload);
+            std::memcpy(frame + EthIpv4Udp::HEADERS_LEN, packets[i].iov[0].iov_base, header_len);
+            std::memcpy(frame + EthIpv4Udp::HEADERS_LEN + header_len, packets[i].iov[1].iov_base, payload_len);
+            xsk_->tx_queue(frame, EthIpv4Udp::HEADERS_LEN + udp_payload);
+        }
+        xsk_->kick();
+    }
+
+    /**
+     * @brief XDP Mode: open the AF_XDP socket (once).
+     * @return false (with a warning) if it cannot be used.
+     */
+    bool init_xdp() {
+        if (xsk_) return true;
+        if (xdp_ifname_.empty()) {
+            std::cerr << "[WARNING] UdpSink: no AF_XDP interface set, using sendmmsg" << std::endl;
+            return false;
+        }
+        if (!XdpSocket::get_mac(xdp_ifname_, xdp_src_mac_) ||
+            (xdp_src_ip_ == 0 && !XdpSocket::get_ipv4(xdp_ifname_, xdp_src_ip_))) {
+            std::cerr << "[WARNING] UdpSink: cannot get the MAC/IPv4 address of " << xdp_ifname_
+                      << ", using sendmmsg" << std::endl;
+            return false;
+        }
+        try {
+            xsk_.reset(new XdpSocket(xdp_ifname_, xdp_queue_, 0, XDP_TX_FRAMES, XDP_FRAME_SIZE));
+        } catch (const std::runtime_error& e) {
+            std::cerr << "[WARNING] UdpSink: " << e.what() << ", using sendmmsg" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Retransmission: copy the frame being sent into its slot.
+     */
+    void retain(const void* data, size_t size, uint32_t frame_id) {
+        std::lock_guard<std::mutex> lock(retx_mutex_);
+        RetainedFrame& frame = retained_[frame_id % retained_.size()];
+        if (frame.valid && retx_prepared_ && retx_prepared_id_ == frame.frame_id) retx_prepared_ = false;
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        frame.data.assign(bytes, bytes + size);
+        frame.frame_id = frame_id;
+        frame.payload_size = packetizer_.get_payload_size();
+        frame.version = packetizer_.get_protocol_version();
+        frame.valid = true;
+    }
+
+    /**
+     * @brief Retransmission: serve the NACKs arriving on the feedback socket.
+     */
+    void feedback_loop() {
+        std::vector<uint8_t> datagram(sizeof(SpuNackHeader) + SPU_UDP_NACK_MAX_RANGES * sizeof(SpuNackRange));
+        int fd = feedback_socket_->get_fd();
+        while (feedback_running_) {
+            ssize_t len = recv(fd, datagram.data(), datagram.size(), 0);
+            if (len < 0) continue; // Timeout (checks feedback_running_) or EINTR
+
+            SpuCreditHeader credit;
+            if (spu_udp_parse_credit(datagram.data(), static_cast<size_t>(len), credit)) {
+                apply_credit(credit);
+                continue;
+            }
+            SpuNackHeader header;
+            if (!spu_udp_parse_nack(datagram.data(), static_cast<size_t>(len), header)) continue;
+            nacks_received_++;
+            SpuNackRange ranges[SPU_UDP_NACK_MAX_RANGES];
+            std::memcpy(ranges, &datagram[sizeof(header)], header.range_count * sizeof(SpuNackRange));
+            resend(header.frame_id, ranges, header.range_count);
+        }
+    }
+
+    /**
+     * @brief Run the feedback thread on 'port' as long as retransmission or flow control
+     * is on (restarted if the port changes).
+     */
+    void update_feedback(uint16_t port) {
+        const bool needed = !retained_.empty() || credit_enabled_;
+        if (feedback_thread_.joinable() && (!needed || port != feedback_port_)) stop_feedback();
+        if (!needed || feedback_thread_.joinable()) return;
+
+        feedback_socket_.reset(new UdpSocket());
+        feedback_socket_->bind_port(port);
+        feedback_socket_->set_recv_timeout(100);
+        feedback_port_ = port;
+        feedback_running_ = true;
+        feedback_thread_ = std::thread(&BasicUdpSink::feedback_loop, this);
+    }
+
+    /**
+     * @brief Flow control: take a grant in, unless an older one of the same session.
+     */
+    void apply_credit(const SpuCreditHeader& credit) {
+        std::lock_guard<std::mutex> lock(credit_mutex_);
+        const bool new_session = !credit_valid_ || credit.session != credit_session_;
+        if (!new_session && static_cast<int32_t>(credit.seq - credit_seq_) <= 0) return;
+        if ((credit.flags & SPU_UDP_CREDIT_FLAG_ANY_BASE) == 0) {
+            credit_base_ = credit.next_frame;
+            credit_rebase_ = false;
+        } else if (new_session) {
+            credit_rebase_ = true;
+        }
+        credit_session_ = credit.session;
+        credit_seq_ = credit.seq;
+        credit_frames_ = credit.frames;
+        credit_bytes_ = credit.bytes;
+        credit_valid_ = true;
+        credit_cv_.notify_all();
+    }
+
+    /**
+     * @brief Flow control: true if the next frame ('size' bytes) fits the grant. A frame
+     * larger than the byte credit goes alone. Called with credit_mutex_ held.
+     */
+    bool has_credit(size_t size) {
+        if (!credit_valid_) return false;
+        if (credit_rebase_) {
+            credit_base_ = frame_counter_;
+            credit_rebase_ = false;
+        }
+        while (!credit_sent_.empty() && static_cast<int32_t>(credit_sent_.front().first - credit_base_) < 0) {
+            credit_sent_bytes_ -= credit_sent_.front().second;
+            credit_sent_.pop_front();
+        }
+        if (static_cast<int64_t>(static_cast<int32_t>(frame_counter_ - credit_base_)) >= credit_frames_) return false;
+        return credit_sent_.empty() || credit_sent_bytes_ + size <= credit_bytes_;
+    }
+
+    /**
+     * @brief Flow control: wait for credit for the next frame (following credit_policy_)
+     * and charge it.
+     * @return false if the frame must be dropped.
+     */
+    bool acquire_credit(size_t size) {
+        std::unique_lock<std::mutex> lock(credit_mutex_);
+        if (!has_credit(size)) {
+            if (credit_policy_ == CreditPolicy::DROP) return false;
+            auto ready = [this, size] { return has_credit(size); };
+            if (credit_timeout_ms_ < 0) credit_cv_.wait(lock, ready);
+            else if (!credit_cv_.wait_for(lock, std::chrono::milliseconds(credit_timeout_ms_), ready)) return false;
+        }
+        credit_sent_.push_back(std::make_pair(frame_counter_, size));
+        credit_sent_bytes_ += size;
+        return true;
+    }
+
+    /**
+     * @brief Retransmission: resend the fragments of 'frame_id' in 'ranges', if it is still retained.
+     */
+    void resend(uint32_t frame_id, const SpuNackRange* ranges, size_t range_count) {
+        std::lock_guard<std::mutex> lock(retx_mutex_);
+        if (retained_.empty()) return; // Flow control only
+        const RetainedFrame& frame = retained_[frame_id % retained_.size()];
+        if (!frame.valid || frame.frame_id != frame_id) return;
+
+        if (!retx_prepared_ || retx_prepared_id_ != frame_id) {
+            retx_packetizer_.set_payload_size(frame.payload_size);
+            retx_packetizer_.set_protocol_version(frame.version);
+            retx_packetizer_.prepare_frame(frame.data.data(), frame.data.size(), frame_id);
+            retx_prepared_ = true;
+            retx_prepared_id_ = frame_id;
+        }
+        const auto* packets = retx_packetizer_.get_packets();
+        const size_t total = retx_packetizer_.get_count();
+        const auto* dest = socket_.get_dest_addr();
+
+        retx_msgs_.clear();
+        for (size_t r = 0; r < range_count; ++r) {
+            size_t end = std::min(total, static_cast<size_t>(ranges[r].first) + ranges[r].count);
+            for (size_t i = ranges[r].first; i < end; ++i) {
+                struct mmsghdr msg;
+                std::memset(&msg, 0, sizeof(msg));
+                msg.msg_hdr.msg_iov = (struct iovec*)packets[i].iov;
+                msg.msg_hdr.msg_iovlen = 2;
+                msg.msg_hdr.msg_name = (void*)dest;
+                msg.msg_hdr.msg_namelen = sizeof(*dest);
+                retx_msgs_.push_back(msg);
+            }
         }
+
+        int fd = feedback_socket_->get_fd();
+        size_t sent = 0;
+        while (sent < retx_msgs_.size()) {
+            int retval = sendmmsg(fd, &retx_msgs_[sent], retx_msgs_.size() - sent, 0);
+            if (retval < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) continue;
+                perror("UdpSink: retransmission sendmmsg failed");
+                break;
+            }
+            sent += retval;
+        }
+        retransmitted_fragments_ += sent;
+    }
+
+    void stop_feedback() {
+        if (!feedback_thread_.joinable()) return;
+        feedback_running_ = false;
+        feedback_thread_.join();
+        feedback_socket_.reset();
+    }
+
+    /**
+     * @brief Pacing: resolve 'mode' and set the kernel or user-space side up.
+     */
+    void apply_pacing(PacingMode mode, size_t burst_bytes) {
+        if (mode == PacingMode::AUTO) mode = default_qdisc_is_fq() ? PacingMode::KERNEL : PacingMode::USER;
+        const bool enabled = pacing_rate_ > 0 || pacing_spread_us_ > 0;
+        if (kernel_pacing_rate_ != 0) {
+            socket_.set_max_pacing_rate(~uint64_t(0));
+            kernel_pacing_rate_ = 0;
+        }
+        if (enabled && mode == PacingMode::KERNEL && !socket_.set_max_pacing_rate(~uint64_t(0))) {
+            std::cerr << "[WARNING] UdpSink: SO_MAX_PACING_RATE not supported, pacing in user space" << std::endl;
+            mode = PacingMode::USER;
+        }
+        if (enabled && mode == PacingMode::USER && !txtime_) {
+            txtime_ = socket_.enable_txtime();
+            if (!txtime_)
+                std::cerr << "[WARNING] UdpSink: SO_TXTIME not supported, datagrams of a burst leave back to back" << std::endl;
+        }
+        pacing_mode_ = mode;
+        pacing_burst_request_ = burst_bytes;
+        pacing_burst_ = burst_size();
+        pacing_next_ns_ = 0;
+        txtime_launch_ns_ = 0;
+        if (pacing_rate_ > 0 && mode == PacingMode::KERNEL) set_kernel_rate(pacing_rate_);
+    }
+
+    /**
+     * @brief Pacing: true unless the qdisc does it (never on the XDP path, which has none).
+     */
+    bool user_pacing() const { return pacing_mode_ == PacingMode::USER || tx_mode_ == TxMode::XDP; }
+
+    /**
+     * @brief Pacing: /proc/sys/net/core/default_qdisc, the qdisc of devices that got no other one.
+     */
+    static bool default_qdisc_is_fq() {
+        std::ifstream file("/proc/sys/net/core/default_qdisc");
+        std::string qdisc;
+        return (file >> qdisc) && qdisc == "fq";
+    }
+
+    size_t burst_size() const {
+        if (pacing_burst_request_ > 0) return pacing_burst_request_;
+        return static_cast<size_t>(static_cast<double>(pacing_rate_) * PACING_BURST_NS / 1e9);
+    }
+
+    void set_kernel_rate(uint64_t rate) {
+        if (rate == kernel_pacing_rate_) return;
+        socket_.set_max_pacing_rate(rate);
+        kernel_pacing_rate_ = rate;
+    }
+
+    /**
+     * @brief Frame pacing: the rate that sends the prepared frame in pacing_spread_us_.
+     */
+    void set_frame_rate(size_t packet_count) {
+        const auto* packets = packetizer_.get_packets();
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < packet_count; ++i) bytes += wire_size(packets[i]);
+        uint64_t rate = bytes * 1000000 / pacing_spread_us_;
+        pacing_rate_ = rate > 0 ? rate : 1;
+        if (user_pacing()) pacing_burst_ = burst_size();
+        else set_kernel_rate(pacing_rate_);
+    }
+
+    /**
+     * @brief Bytes a packet takes on the wire above the link layer.
+     */
+    static size_t wire_size(const typename Packetizer::Packet& p) {
+        return SPU_UDP_IP_OVERHEAD + p.iov[0].iov_len + p.iov[1].iov_len;
+    }
+
+    static uint64_t monotonic_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    /**
+     * @brief Pacing: wait until the token bucket (pacing_burst_ deep) holds 'bytes', then
+     * take them. Sets the launch time of the burst's first datagram if SO_TXTIME is on.
+     */
+    void pace(size_t bytes) {
+        const double ns_per_byte = 1e9 / static_cast<double>(pacing_rate_);
+        const uint64_t cost_ns = static_cast<uint64_t>(static_cast<double>(bytes) * ns_per_byte);
+        const size_t headroom = pacing_burst_ > bytes ? pacing_burst_ - bytes : 0;
+        const uint64_t headroom_ns = static_cast<uint64_t>(static_cast<double>(headroom) * ns_per_byte);
+
+        uint64_t now = monotonic_ns();
+        if (pacing_next_ns_ > now + headroom_ns) {
+            uint64_t wake = pacing_next_ns_ - headroom_ns;
+            struct timespec ts;
+            ts.tv_sec = static_cast<time_t>(wake / 1000000000u);
+            ts.tv_nsec = static_cast<long>(wake % 1000000000u);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+            now = wake;
+        }
+        const uint64_t start = std::max(pacing_next_ns_, now);
+        pacing_next_ns_ = start + cost_ns;
+
+        const bool stamped = txtime_ && (tx_mode_ == TxMode::SENDMMSG || tx_mode_ == TxMode::GSO);
+        txtime_launch_ns_ = stamped ? start : 0;
+        txtime_ns_per_byte_ = ns_per_byte;
+    }
+
+    /**
+     * @brief Pacing: attach control message 'index' to 'msg', with the launch time of a
+     * datagram sent after 'bytes' bytes of the burst.
+     */
+    void set_launch_time(struct msghdr& msg, size_t index, size_t bytes) {
+        if (txtime_control_.size() < (index + 1) * TXTIME_CONTROL_WORDS)
+            txtime_control_.resize(std::max(msg_vec_.size(), index + 1) * TXTIME_CONTROL_WORDS);
+        msg.msg_control = &txtime_control_[index * TXTIME_CONTROL_WORDS];
+        msg.msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_TXTIME;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+        uint64_t launch = txtime_launch_ns_ + static_cast<uint64_t>(static_cast<double>(bytes) * txtime_ns_per_byte_);
+        std::memcpy(CMSG_DATA(cmsg), &launch, sizeof(launch));
+    }
+
+    int send_flags() const { return zerocopy_ ? MSG_ZEROCOPY : 0; }
+
+    /**
+     * @brief GSO Mode: wire size of a full fragment (header + payload).
+     */
+    size_t gso_segment_size() const { return packetizer_.get_header_size() + packetizer_.get_payload_size(); }
+
+    /**
+     * @brief Resolve the payload size (see set_payload_size()) and resize what depends on it.
+     */
+    void apply_payload_size() {
+        const size_t xdp_max_bytes = XDP_FRAME_SIZE - EthIpv4Udp::HEADERS_LEN - SPU_UDP_V2_HEADER_SIZE;
+        size_t bytes = payload_size_;
+        if (Packetizer::FIXED_PAYLOAD) {
+            bytes = packetizer_.get_payload_size();
+            if (tx_mode_ == TxMode::XDP && bytes > xdp_max_bytes) {
+                std::cerr << "[WARNING] UdpSink: payload size too large for the UMEM frames, using sendmmsg" << std::endl;
+                tx_mode_ = TxMode::SENDMMSG;
+            }
+            if (zerocopy_ && bytes > ZEROCOPY_MAX_PAYLOAD) {
+                std::cerr << "[WARNING] UdpSink: payload size too large for MSG_ZEROCOPY, payloads will be copied" << std::endl;
+                wait_all_released();
+                zerocopy_ = false;
+            }
+        } else {
+            if (bytes == 0) {
+                int mtu = socket_.get_path_mtu();
+                bytes = SPU_UDP_MAX_PAYLOAD;
+                if (mtu > static_cast<int>(SPU_UDP_IP_OVERHEAD + SPU_UDP_V2_HEADER_SIZE))
+                    bytes = static_cast<size_t>(mtu) - SPU_UDP_IP_OVERHEAD - SPU_UDP_V2_HEADER_SIZE;
+            }
+            size_t max_bytes = SPU_UDP_MAX_DATAGRAM - SPU_UDP_V2_HEADER_SIZE;
+            if (tx_mode_ == TxMode::XDP) max_bytes = xdp_max_bytes;
+            if (zerocopy_ && max_bytes > ZEROCOPY_MAX_PAYLOAD) max_bytes = ZEROCOPY_MAX_PAYLOAD;
+            if (bytes > max_bytes) bytes = max_bytes;
+        }
+
+        if (zerocopy_) wait_all_released(); // Headers of the previous frame may still be pinned
+        packetizer_.set_payload_size(bytes);
+
+        if (tx_mode_ == TxMode::GSO && !socket_.set_gso_segment(static_cast<int>(gso_segment_size())))
+            set_tx_mode(TxMode::SENDMMSG);
+        if (tx_mode_ == TxMode::IO_URING && uring_slot_size_ < SPU_UDP_V2_HEADER_SIZE + bytes) {
+            // Staging slots too small: start over with a new arena
+            wait_all_sent();
+            uring_.reset();
+            if (!init_uring()) tx_mode_ = TxMode::SENDMMSG;
+        }
+    }
+
+    /**
+     * @brief Zero-Copy Mode: account for 'count' successful sends (one notification id each).
+     */
+    void issued(int count) {
+        if (!zerocopy_) return;
+        for (int i = 0; i < count; ++i) zc_done_.push_back(false);
+        zc_next_id_ += count;
+    }
+
+    /**
+     * @brief Zero-Copy Mode: drain the socket error queue.
+     * @param timeout_ms How long to wait if no notification is pending (0: do not wait).
+     */
+    void reap_completions(int timeout_ms) {
+        if (zc_done_.empty()) return; // No send waiting for its notification
+        int fd = socket_.get_fd();
+        bool got_one = false;
+
+        while (true) {
+            char control[128];
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                if (errno == EINTR) continue;
+                if (!got_one && timeout_ms > 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    // The error queue is signalled as POLLERR, which needs no event bit
+                    struct pollfd pfd = {fd, 0, 0};
+                    poll(&pfd, 1, timeout_ms);
+                    timeout_ms = 0;
+                    continue;
+                }
+                break;
+            }
+            got_one = true;
+
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)) continue;
+                struct sock_extended_err serr;
+                std::memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+                if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+                // Ids [ee_info, ee_data] are released
+                for (uint32_t id = serr.ee_info; static_cast<int32_t>(serr.ee_data - id) >= 0; ++id) {
+                    uint32_t idx = id - zc_base_;
+                    if (idx < zc_done_.size()) zc_done_[idx] = true;
+                    if (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) zc_copied_++;
+                }
+            }
+        }
+
+        while (!zc_done_.empty() && zc_done_.front()) {
+            zc_done_.pop_front();
+            zc_base_++;
+        }
+        while (!in_flight_.empty() && static_cast<int32_t>(zc_base_ - in_flight_.front().last_id) > 0)
+            in_flight_.pop_front();
     }
 };
 
-#endif // UDP_SINK_HPP
\ No newline at end of file
+typedef BasicUdpSink<> UdpSink;
+
+/**
+ * @brief Sink of a stream whose payload size (and frame size) is known at compile time.
+ */
+template <size_t PayloadSize, size_t FrameSize = 0>
+using FixedUdpSink = BasicUdpSink<FixedUdpPacketizer<PayloadSize, FrameSize>>;
+
+#endif // UDP_SINK_HPP
@@ -9,9 +9,14 @@
 #include <string>
 #include <stdexcept>
 #include <cstring>
+#include <cstdint>
+#include <ctime>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <linux/net_tstamp.h> // struct sock_txtime
 
 class UdpSocket {
 private:
@@ -71,6 +76,80 @@ public:
         is_bound_ = true;
     }
 
+    /**
+     * @brief Allow several sockets to bind the same port (load balancing group).
+     * Must be called before bind_port().
+     */
+    void set_reuse_port() {
+        int opt = 1;
+        if (setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+            throw std::runtime_error("UdpSocket: Failed to set SO_REUSEPORT");
+        }
+    }
+
+    /**
+     * @brief Let the kernel coalesce consecutive datagrams (UDP GRO, Linux >= 5.0).
+     * Coalesced reads carry the segment size in a SOL_UDP/UDP_GRO control message.
+     * @return false if the kernel does not support it.
+     */
+    bool enable_gro() {
+        int opt = 1;
+        return setsockopt(sockfd_, IPPROTO_UDP, UDP_GRO, &opt, sizeof(opt)) == 0;
+    }
+
+    /**
+     * @brief Let the kernel split each send into 'segment_size' datagrams (UDP GSO, Linux >= 4.18).
+     * A send of at most 'segment_size' bytes still goes out as a single datagram.
+     * @return false if the kernel does not support it.
+     */
+    bool set_gso_segment(int segment_size) {
+        return setsockopt(sockfd_, IPPROTO_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) == 0;
+    }
+
+    /**
+     * @brief Allow MSG_ZEROCOPY sends (Linux >= 4.14 for UDP: 5.0).
+     * @return false if the kernel does not support it.
+     */
+    bool enable_zerocopy() {
+        int opt = 1;
+        return setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)) == 0;
+    }
+
+    /**
+     * @brief Cap the pacing rate of the socket (SO_MAX_PACING_RATE, Linux >= 3.13).
+     * Only the fq qdisc enforces it for UDP: it then spaces the datagrams out.
+     * ~0 lifts the cap.
+     * @return false if the kernel does not support it.
+     */
+    bool set_max_pacing_rate(uint64_t bytes_per_second) {
+        // 32 bits where it fits: kernels before 4.20 read only that much (~0u: no cap)
+        if (bytes_per_second < 0xFFFFFFFFu || bytes_per_second == ~uint64_t(0)) {
+            uint32_t rate = static_cast<uint32_t>(bytes_per_second);
+            return setsockopt(sockfd_, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == 0;
+        }
+        return setsockopt(sockfd_, SOL_SOCKET, SO_MAX_PACING_RATE, &bytes_per_second, sizeof(bytes_per_second)) == 0;
+    }
+
+    /**
+     * @brief Accept launch times on sends (SO_TXTIME, Linux >= 4.19): an SCM_TXTIME control
+     * message carrying CLOCK_MONOTONIC nanoseconds. The fq and etf qdiscs hold the datagram
+     * until then, other qdiscs send it right away.
+     * @return false if the kernel does not support it.
+     */
+    bool enable_txtime() {
+        struct sock_txtime config;
+        config.clockid = CLOCK_MONOTONIC;
+        config.flags = 0;
+        return setsockopt(sockfd_, SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) == 0;
+    }
+
+    /**
+     * @brief Resize the kernel receive buffer (the kernel enforces a minimum).
+     */
+    void set_recv_buffer(int bytes) {
+        setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+    }
+
     /**
      * @brief Client Mode: Set the default destination.
      */
@@ -93,6 +172,24 @@ public:
         setsockopt(sockfd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
     }
 
+    /**
+     * @brief MTU of the route to the destination (IP_MTU of a socket connected to it),
+     * which includes what the kernel learned from path MTU discovery.
+     * A separate socket is used: a connected one would report ICMP errors on sends.
+     * @return 0 if it cannot be determined.
+     */
+    int get_path_mtu() const {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) return 0;
+        int mtu = 0;
+        socklen_t optlen = sizeof(mtu);
+        if (connect(fd, reinterpret_cast<const struct sockaddr*>(&dest_addr_), sizeof(dest_addr_)) < 0 ||
+            getsockopt(fd, IPPROTO_IP, IP_MTU, &mtu, &optlen) < 0)
+            mtu = 0;
+        close(fd);
+        return mtu;
+    }
+
     int get_fd() const { return sockfd_; }
     const struct sockaddr_in* get_dest_addr() const { return &dest_addr_; }
 };
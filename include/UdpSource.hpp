@@ -12,140 +12,1115 @@
 
 #include "UdpSocket.hpp"
 #include "UdpReassembler.hpp"
+#include "SpscRing.hpp"
+#include "IoUring.hpp"
+#include "XdpSocket.hpp"
+#include "PacketRing.hpp"
 #include <thread>
 #include <atomic>
-#include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <random>
+#include <linux/filter.h>
+#include <poll.h>
+
+/**
+ * @brief Receive path used by the UdpSource receive threads.
+ */
+enum class UdpRxMode {
+    RECVMMSG,   // Datagrams land in a bounce buffer, payload copied into the frame
+    SCATTER,    // Header to a side array, payload straight into its predicted frame slot
+    GRO,        // Kernel-coalesced super-datagrams (UDP_GRO), split into SPU fragments
+    IO_URING,   // Multishot io_uring recv into a provided-buffer ring (falls back to RECVMMSG)
+    XDP,        // Kernel bypass (AF_XDP): XDP redirects the port to one AF_XDP socket per shard/RX queue
+    PACKET_MMAP // AF_PACKET TPACKET_V3 block ring filtered on the port (fanout by frame_id)
+};
+
+/**
+ * @brief Source over a given reassembler: UdpReassembler (UdpSource), or a
+ * FixedUdpReassembler for streams whose geometry is known at compile time (FixedUdpSource).
+ */
+template <class Reassembler = UdpReassembler>
+class BasicUdpSource {
+public:
+    typedef UdpRxMode RxMode;
 
-class UdpSource {
 private:
-    UdpSocket socket_;
-    UdpReassembler reassembler_;
+    struct CompletedFrame {
+        uint32_t frame_id;
+        FrameBuffer data;
+    };
+
+    /**
+     * @brief One receive thread with its own socket, reassembler and output ring.
+     * With n_threads > 1 all shard sockets share the port (SO_REUSEPORT) and a
+     * reuseport BPF program steers every fragment of a frame to the same shard.
+     */
+    struct Shard {
+        UdpSocket socket;
+        Reassembler reassembler;
+        std::thread thread;
+
+        // Output Queue (Lock-free SPSC: receive_loop -> consumer)
+        SpscRing<CompletedFrame> completed_frames;
+
+        // Direct Mode: consumer buffer handed to the reassembler (see pop_frame_into)
+        // target_mutex is held by receive_loop while it processes a batch.
+        std::mutex target_mutex;
+        std::atomic<bool> target_ready{false};
+        size_t target_size = 0;         // Published by target_ready
+        uint32_t target_frame_id = 0;   // Published by target_ready
+
+        // XDP/PACKET_MMAP Modes: opened by start() so that no packet is missed
+        unsigned index;                 // XDP Mode: RX queue served by this shard
+        std::unique_ptr<XdpSocket> xsk;
+        std::unique_ptr<PacketRing> packet_ring;
+
+        Shard(size_t queue_capacity, unsigned shard_index) : completed_frames(queue_capacity), index(shard_index) {}
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
 
     // Threading
-    std::thread worker_thread_;
     std::atomic<bool> running_{false};
+    RxMode rx_mode_ = RxMode::RECVMMSG;
+    std::atomic<size_t> dropped_frames_{0};
+    uint16_t listen_port_;
 
-    // Output Queue (Thread-safe)
-    std::queue<std::vector<uint8_t>> completed_frames_;
-    std::mutex queue_mutex_;
-    std::condition_variable queue_cv_;
+    // XDP/PACKET_MMAP Modes: interface the traffic arrives on; XDP program shared by the shards
+    std::string ifname_;
+    std::unique_ptr<XdpProgram> xdp_program_;
 
-    // Temporary receive buffer (stack allocated or reusable heap buffer)
-    // Size = Header + Payload + padding safety
-    // UPDATED: Using SpuUdpHeader and SPU_UDP_MAX_PAYLOAD
-    static const size_t RX_BUFFER_SIZE = sizeof(SpuUdpHeader) + SPU_UDP_MAX_PAYLOAD + 64;
+    // Direct Mode: frame N reaches shard N % n_threads only if something steers it there
+    // (reuseport BPF, fanout). Otherwise the target goes to the shard the stream lands on.
+    bool reuseport_steering_ = true;
+    bool frame_steering_ = true;
+    std::atomic<unsigned> stream_shard_{0};  // Shard that completed the latest frame
+
+    // Retransmission: NACKs go from the shard sockets to the sender's feedback port
+    int nack_delay_ms_ = -1;
+    std::thread feedback_thread_;                 // NACKs and periodic credit grants
+    std::atomic<size_t> nacks_sent_{0};
+    static const size_t NACK_MAX_FRAMES = 64;     // NACKs per shard and round
+
+    // Flow control: credit grants (see SpuCreditHeader) go from the first shard socket to
+    // the sender's feedback port, every credit_interval_ms_ and as the consumer takes frames
+    int credit_interval_ms_ = -1;                 // -1: off
+    size_t credit_frames_request_ = 0;            // 0: what the queues and window hold
+    uint64_t credit_bytes_request_ = 0;           // 0: the reassembly memory budgets
+    std::mutex credit_mutex_;                     // Members below
+    uint32_t credit_frames_ = 0;
+    uint64_t credit_bytes_ = 0;
+    uint32_t credit_session_ = 0;
+    uint32_t credit_seq_ = 0;
+    uint32_t credit_next_ = 0;                    // Frame the consumer takes next
+    bool credit_consumed_any_ = false;
+    std::atomic<size_t> credits_sent_{0};
+
+    // Consumer-side merge state: the frame expected next (picks the shard to read from)
+    uint32_t next_frame_id_ = 0;
+    CompletedFrame stash_;          // Direct frame set aside to keep delivery in order
+    bool has_stash_ = false;
+
+    // Blocking fallback, only used when the consumer finds nothing to pop
+    std::mutex wait_mutex_;
+    std::condition_variable wait_cv_;
+    std::atomic<bool> consumer_waiting_{false};
+
+    // Receive buffer size = largest datagram accepted (header + payload): senders pick
+    // their payload size from the path MTU, up to a whole 64 KB datagram on loopback.
+    // A reassembler with a fixed payload size drops larger ones anyway.
+    size_t rx_buffer_size_ = Reassembler::FIXED_PAYLOAD_SIZE != 0
+                                 ? SPU_UDP_V2_HEADER_SIZE + Reassembler::FIXED_PAYLOAD_SIZE
+                                 : SPU_UDP_MAX_DATAGRAM;
+
+    // GRO Mode: one read may hold up to a full 64 KB UDP datagram
+    static const size_t GRO_BUFFER_SIZE = 65535;
+
+    // io_uring Mode: datagram buffers handed to the kernel (power of two, as many as
+    // fit in URING_BUFFER_BYTES within these bounds)
+    static const size_t URING_BUFFER_BYTES = size_t(16) << 20;
+    static const unsigned URING_MIN_BUFFERS = 64;
+    static const unsigned URING_MAX_BUFFERS = 1024;
+
+    // AF_XDP Mode: UMEM frames per shard, packets handled per target lock
+    static const unsigned XDP_RX_FRAMES = 4096;
+    static const unsigned XDP_BATCH_SIZE = 256;
+
+    // PACKET_MMAP Mode: ring blocks handled per target lock
+    static const unsigned PACKET_BATCH_BLOCKS = 1;
 
 public:
-    UdpSource(uint16_t listen_port) {
-        socket_.bind_port(listen_port);
-        socket_.set_recv_timeout(100);
+    /**
+     * @param queue_capacity Completed frames buffered (per thread) before new ones are dropped.
+     * @param n_threads Number of receive threads/sockets sharing the port.
+     */
+    BasicUdpSource(uint16_t listen_port, size_t queue_capacity = 64, unsigned n_threads = 1)
+    : listen_port_(listen_port) {
+        if (n_threads == 0) n_threads = 1;
+        for (unsigned i = 0; i < n_threads; ++i) {
+            std::unique_ptr<Shard> shard(new Shard(queue_capacity, i));
+            if (n_threads > 1) shard->socket.set_reuse_port();
+            shard->socket.bind_port(listen_port);
+            shard->socket.set_recv_timeout(100);
+            shards_.push_back(std::move(shard));
+        }
+        if (n_threads > 1) attach_frame_id_steering();
     }
 
-    ~UdpSource() {
+    ~BasicUdpSource() {
         stop();
     }
 
     void start() {
         if (running_) return;
+        if (rx_mode_ == RxMode::XDP) open_xdp();
+        if (rx_mode_ == RxMode::PACKET_MMAP) open_packet_rings();
+        frame_steering_ = shards_.size() == 1 || rx_mode_ == RxMode::PACKET_MMAP ||
+                          (rx_mode_ != RxMode::XDP && reuseport_steering_);
+        if (rx_mode_ == RxMode::XDP && shards_.size() > 1) {
+            std::cerr << "[WARNING] UdpSource: AF_XDP shards follow the RX queues, not frame IDs: "
+                      << "pop_frame_into() targets the shard that receives the stream" << std::endl;
+        }
         running_ = true;
-        worker_thread_ = std::thread(&UdpSource::receive_loop, this);
+        for (auto& shard : shards_)
+            shard->thread = std::thread(&BasicUdpSource::receive_loop, this, std::ref(*shard));
+        if (credit_interval_ms_ >= 0) resolve_credit();
+        if (nack_delay_ms_ >= 0 || credit_interval_ms_ >= 0)
+            feedback_thread_ = std::thread(&BasicUdpSource::feedback_loop, this);
     }
 
     void stop() {
         if (!running_) return;
         running_ = false;
-        if (worker_thread_.joinable()) {
-            worker_thread_.join();
+        wake_consumer();
+        for (auto& shard : shards_) {
+            if (shard->thread.joinable()) shard->thread.join();
+        }
+        if (feedback_thread_.joinable()) feedback_thread_.join();
+        for (auto& shard : shards_) {
+            shard->xsk.reset();
+            shard->packet_ring.reset();
+        }
+        xdp_program_.reset(); // Detach: traffic goes back to the socket
+    }
+
+    /**
+     * @brief Select the receive path. Call before start().
+     */
+    void set_rx_mode(RxMode mode) { rx_mode_ = mode; }
+
+    /**
+     * @brief XDP/PACKET_MMAP Modes: interface carrying the SPU traffic. Call before start().
+     * XDP: shard i serves RX queue i; needs CAP_NET_ADMIN/CAP_BPF and uses generic (SKB)
+     * XDP so any device works (e.g. veth). PACKET_MMAP: needs CAP_NET_RAW, works on "lo".
+     */
+    void set_interface(const std::string& ifname) { ifname_ = ifname; }
+
+    /**
+     * @brief Largest datagram (SPU header + payload) accepted, bigger ones are dropped.
+     * The default, SPU_UDP_MAX_DATAGRAM, takes any payload size a sender may use (with
+     * a fixed payload size: that payload behind a v2 header); a lower value saves receive
+     * buffer memory when the senders' MTU is known (e.g. 1500 on Ethernet).
+     * XDP/PACKET_MMAP Modes are bounded by their frames instead. Call before start().
+     */
+    void set_max_datagram_size(size_t bytes) {
+        if (bytes < sizeof(SpuUdpHeader)) bytes = sizeof(SpuUdpHeader);
+        if (bytes > SPU_UDP_MAX_DATAGRAM) bytes = SPU_UDP_MAX_DATAGRAM;
+        rx_buffer_size_ = bytes;
+    }
+
+    size_t get_max_datagram_size() const { return rx_buffer_size_; }
+
+    /**
+     * @brief Pre-populate the reassembly buffer pool for frames of 'frame_size' bytes.
+     * Call before start().
+     */
+    void preallocate_frames(size_t frame_size, size_t count) {
+        for (auto& shard : shards_)
+            shard->reassembler.preallocate(frame_size, count);
+    }
+
+    /**
+     * @brief Number of consecutive frame IDs each shard reassembles concurrently
+     * (see UdpReassembler::set_window()). Call before start().
+     */
+    void set_reassembly_window(size_t frames) {
+        for (auto& shard : shards_)
+            shard->reassembler.set_window(frames);
+    }
+
+    /**
+     * @brief Drop incomplete frames that received nothing for 'timeout_ms'
+     * (see UdpReassembler::set_frame_timeout()). Call before start().
+     */
+    void set_frame_timeout(int timeout_ms) {
+        for (auto& shard : shards_)
+            shard->reassembler.set_frame_timeout(timeout_ms);
+    }
+
+    /**
+     * @brief Cap the reassembly memory of each shard (see UdpReassembler::set_memory_budget()).
+     * Call before start().
+     */
+    void set_memory_budget(size_t bytes_per_thread,
+                           ReassemblyEvictionPolicy policy = ReassemblyEvictionPolicy::OLDEST_FIRST) {
+        for (auto& shard : shards_)
+            shard->reassembler.set_memory_budget(bytes_per_thread, policy);
+    }
+
+    /**
+     * @brief Retransmission (ARQ): report the fragments missing from each frame to the
+     * sender (a UdpSink with set_retransmission() on 'feedback_port' of 'sender_ip').
+     * A frame is reported once it received nothing for 'delay_ms', which leaves room
+     * for reordering, then every 'retry_ms' while fragments are still missing (see
+     * UdpReassembler::poll_nack()). Frames of which nothing arrived cannot be reported.
+     * Call before start().
+     */
+    void set_nack(const std::string& sender_ip, uint16_t feedback_port, int delay_ms = 2, int retry_ms = 20) {
+        for (auto& shard : shards_) {
+            shard->socket.set_destination(sender_ip, feedback_port);
+            shard->reassembler.set_nack(delay_ms, retry_ms);
+        }
+        nack_delay_ms_ = delay_ms < 0 ? 0 : delay_ms;
+    }
+
+    /**
+     * @brief Retransmission: NACK datagrams sent (all threads).
+     */
+    size_t get_nacks_sent() const { return nacks_sent_.load(); }
+
+    /**
+     * @brief Flow control: grant the sender (a UdpSink with set_flow_control() on
+     * 'feedback_port' of 'sender_ip') credit for the frames this source can take in:
+     * from the next one the consumer takes, 'frames' frames of at most 'bytes' bytes in
+     * all. 0 (default) means what the output queues and the reassembly window hold without
+     * dropping (frames), and the reassembly memory budgets (bytes). Grants go out every
+     * 'interval_ms' and each time the consumer takes a frame. Call before start().
+     */
+    void set_flow_control(const std::string& sender_ip, uint16_t feedback_port, size_t frames = 0,
+                          uint64_t bytes = 0, int interval_ms = 10) {
+        for (auto& shard : shards_) shard->socket.set_destination(sender_ip, feedback_port);
+        credit_frames_request_ = frames;
+        credit_bytes_request_ = bytes;
+        credit_interval_ms_ = interval_ms > 0 ? interval_ms : 1;
+        std::lock_guard<std::mutex> lock(credit_mutex_);
+        credit_session_ = std::random_device()();
+        credit_seq_ = 0;
+    }
+
+    /**
+     * @brief Flow control: credit grants sent.
+     */
+    size_t get_credits_sent() const { return credits_sent_.load(); }
+
+    /**
+     * @brief Wait for the next complete frame.
+     * The returned buffer goes back to the pool when it is destroyed.
+     * @note pop_frame/pop_frame_into must be called from a single consumer thread.
+     */
+    FrameBuffer pop_frame(int timeout_ms = -1) {
+        FrameBuffer frame;
+        if (pop_next(frame)) return frame;
+
+        wait_for_event(timeout_ms, [this] { return any_frame_ready() || !running_; });
+        pop_next(frame);
+        return frame;
+    }
+
+    /**
+     * @brief Number of completed frames dropped because the output queue was full.
+     */
+    size_t get_dropped_frames() const { return dropped_frames_.load(); }
+
+    /**
+     * @brief Frames refused by the reassembly memory budget (all threads).
+     */
+    size_t get_rejected_frames() {
+        size_t total = 0;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->target_mutex);
+            total += shard->reassembler.get_rejected_frames();
         }
+        return total;
     }
 
-    std::vector<uint8_t> pop_frame(int timeout_ms = -1) {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-        auto ready_pred = [this] { return !completed_frames_.empty() || !running_; };
-        bool data_available = false;
+    /**
+     * @brief Incomplete frames evicted by newer frames or by the memory budget (all threads).
+     */
+    size_t get_evicted_frames() {
+        size_t total = 0;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->target_mutex);
+            total += shard->reassembler.get_evicted_frames();
+        }
+        return total;
+    }
+
+    /**
+     * @brief Lost data fragments rebuilt from FEC parity fragments (all threads).
+     */
+    size_t get_recovered_fragments() {
+        size_t total = 0;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->target_mutex);
+            total += shard->reassembler.get_recovered_fragments();
+        }
+        return total;
+    }
+
+    /**
+     * @brief Direct Mode: wait for the next frame and get it written into 'dst'.
+     *
+     * If a frame is already queued it is copied (fallback). Otherwise 'dst' is armed
+     * as the reassembly target, so the next frame's fragments are written into it
+     * directly by the receive thread and no extra copy happens. If that frame is
+     * already in flight, the part received so far is copied once into 'dst'.
+     * The target goes to shard frame_id % n_threads when frames are steered by ID; without
+     * steering (kernel hashing, XDP) to the shard that completed the latest frame, where a
+     * single sender's stream lands.
+     *
+     * @return Number of bytes written into 'dst' (0 on timeout or stop).
+     */
+    size_t pop_frame_into(void* dst, size_t capacity, int timeout_ms = -1) {
+        FrameBuffer frame;
+        if (pop_next(frame))
+            return copy_frame(frame, dst, capacity);
+
+        // Arm the shard that should receive the next frame
+        unsigned index = frame_steering_ ? next_frame_id_ % shards_.size()
+                                         : stream_shard_.load(std::memory_order_relaxed);
+        Shard& shard = *shards_[index];
+        {
+            std::lock_guard<std::mutex> lock(shard.target_mutex);
+            shard.reassembler.set_target(dst, capacity, next_frame_id_);
+        }
+
+        wait_for_event(timeout_ms, [this, &shard] {
+            return shard.target_ready.load(std::memory_order_acquire) || any_frame_ready() || !running_;
+        });
+
+        if (!shard.target_ready.load(std::memory_order_acquire)) {
+            // Disarm the target before touching 'dst': the receive thread may be writing into it.
+            std::lock_guard<std::mutex> target_lock(shard.target_mutex);
+            shard.reassembler.release_target();
+        }
 
+        // The target may have completed while it was being released
+        if (shard.target_ready.exchange(false, std::memory_order_acquire)) {
+            if (!older_frame_ready(shard.target_frame_id)) {
+                consumed(shard.target_frame_id);
+                return shard.target_size;
+            }
+            // Rare: an older frame completed in the same window. Set the target frame
+            // aside (one copy) so that frames are still delivered in order.
+            stash_.frame_id = shard.target_frame_id;
+            stash_.data = shard.reassembler.get_pool()->acquire(shard.target_size);
+            std::memcpy(stash_.data.data(), dst, shard.target_size);
+            has_stash_ = true;
+        }
+        if (pop_next(frame))
+            return copy_frame(frame, dst, capacity);
+        return 0;
+    }
+
+private:
+    static size_t copy_frame(const FrameBuffer& frame, void* dst, size_t capacity) {
+        size_t copy_size = std::min(capacity, frame.size());
+        std::memcpy(dst, frame.data(), copy_size);
+        return copy_size;
+    }
+
+    bool any_frame_ready() {
+        for (auto& shard : shards_)
+            if (!shard->completed_frames.empty()) return true;
+        return has_stash_;
+    }
+
+    bool older_frame_ready(uint32_t frame_id) {
+        for (auto& shard : shards_) {
+            CompletedFrame* head = shard->completed_frames.front();
+            if (head != nullptr && static_cast<int32_t>(head->frame_id - frame_id) < 0) return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Consumer side: 'frame_id' is delivered. With flow control this frees credit.
+     */
+    void consumed(uint32_t frame_id) {
+        next_frame_id_ = frame_id + 1;
+        if (credit_interval_ms_ < 0) return;
+        {
+            std::lock_guard<std::mutex> lock(credit_mutex_);
+            credit_next_ = next_frame_id_;
+            credit_consumed_any_ = true;
+        }
+        send_credit();
+    }
+
+    /**
+     * @brief Flow control: resolve the default credit (see set_flow_control()).
+     */
+    void resolve_credit() {
+        const size_t n = shards_.size();
+        size_t frames = credit_frames_request_;
+        if (frames == 0) frames = std::min(shards_[0]->reassembler.get_window(),
+                                           n * shards_[0]->completed_frames.capacity());
+        uint64_t bytes = credit_bytes_request_;
+        if (bytes == 0) {
+            const uint64_t budget = shards_[0]->reassembler.get_memory_budget();
+            bytes = budget > ~uint64_t(0) / n ? ~uint64_t(0) : budget * n;
+        }
+        std::lock_guard<std::mutex> lock(credit_mutex_);
+        credit_frames_ = static_cast<uint32_t>(std::min<size_t>(frames, 0x7FFFFFFF));
+        credit_bytes_ = bytes;
+    }
+
+    /**
+     * @brief Flow control: send the current grant.
+     */
+    void send_credit() {
+        std::lock_guard<std::mutex> lock(credit_mutex_);
+        SpuCreditHeader credit;
+        credit.magic = SPU_UDP_CREDIT_MAGIC;
+        credit.version = SPU_UDP_VERSION_2;
+        credit.flags = credit_consumed_any_ ? 0 : SPU_UDP_CREDIT_FLAG_ANY_BASE;
+        credit.reserved = 0;
+        credit.session = credit_session_;
+        credit.seq = credit_seq_++;
+        credit.next_frame = credit_next_;
+        credit.frames = credit_frames_;
+        credit.bytes = credit_bytes_;
+        const auto* dest = shards_[0]->socket.get_dest_addr();
+        if (sendto(shards_[0]->socket.get_fd(), &credit, sizeof(credit), 0,
+                   reinterpret_cast<const struct sockaddr*>(dest), sizeof(*dest)) >= 0)
+            credits_sent_++;
+    }
+
+    /**
+     * @brief Merge the shard outputs: take the ready frame closest to next_frame_id_.
+     * With several shards a frame can still overtake an older one that is not complete yet.
+     */
+    bool pop_next(FrameBuffer& out) {
+        Shard* best = nullptr;
+        int32_t best_dist = 0;
+        for (auto& shard : shards_) {
+            CompletedFrame* head = shard->completed_frames.front();
+            if (head == nullptr) continue;
+            int32_t dist = static_cast<int32_t>(head->frame_id - next_frame_id_);
+            if (best == nullptr || dist < best_dist) {
+                best = shard.get();
+                best_dist = dist;
+            }
+        }
+        if (has_stash_ && (best == nullptr || static_cast<int32_t>(stash_.frame_id - next_frame_id_) < best_dist)) {
+            has_stash_ = false;
+            consumed(stash_.frame_id);
+            out = std::move(stash_.data);
+            return true;
+        }
+        if (best == nullptr) return false;
+
+        CompletedFrame frame;
+        best->completed_frames.try_pop(frame);
+        consumed(frame.frame_id);
+        out = std::move(frame.data);
+        return true;
+    }
+
+    /**
+     * @brief Steer packets to shard (frame_id % n_threads) with a classic BPF
+     * reuseport program. The program sees the UDP payload, i.e. the SPU header.
+     */
+    void attach_frame_id_steering() {
+        struct sock_filter code[SPU_UDP_STEERING_LEN];
+        spu_udp_steering_program(code, 0, false, static_cast<uint32_t>(shards_.size()));
+        struct sock_fprog prog;
+        prog.len = sizeof(code) / sizeof(code[0]);
+        prog.filter = code;
+
+        // Attaching to one socket programs the whole reuseport group
+        if (setsockopt(shards_[0]->socket.get_fd(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+            std::cerr << "[WARNING] UdpSource: reuseport BPF unavailable, falling back to kernel hashing "
+                      << "(fragments of one sender will not be spread across threads, pop_frame_into() "
+                      << "targets the shard that receives the stream)" << std::endl;
+            reuseport_steering_ = false;
+        }
+    }
+
+    /**
+     * @brief Consumer side: sleep until 'ready' holds (or timeout).
+     * The producer only touches the mutex when consumer_waiting_ is set.
+     */
+    template <typename Predicate>
+    void wait_for_event(int timeout_ms, Predicate ready) {
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        consumer_waiting_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
         if (timeout_ms < 0) {
-            queue_cv_.wait(lock, ready_pred);
-            data_available = !completed_frames_.empty();
+            wait_cv_.wait(lock, ready);
         } else {
-            data_available = queue_cv_.wait_for(
-                lock,
-                std::chrono::milliseconds(timeout_ms),
-                ready_pred
-            );
-            if (data_available) {
-                data_available = !completed_frames_.empty();
+            wait_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+        }
+        consumer_waiting_.store(false, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Producer side: wake the consumer if (and only if) it is sleeping.
+     */
+    void wake_consumer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumer_waiting_.load(std::memory_order_relaxed)) {
+            { std::lock_guard<std::mutex> lock(wait_mutex_); }
+            wait_cv_.notify_one();
+        }
+    }
+
+    void handle_result(Shard& shard, ReassemblyResult& result) {
+        if (result.complete) stream_shard_.store(shard.index, std::memory_order_relaxed);
+        if (result.complete && result.in_target) {
+            shard.target_size = result.target_size;
+            shard.target_frame_id = result.frame_id;
+            shard.target_ready.store(true, std::memory_order_release);
+            wake_consumer();
+        } else if (result.complete) {
+            CompletedFrame frame = {result.frame_id, std::move(result.data)};
+            if (shard.completed_frames.try_push(std::move(frame))) wake_consumer();
+            else dropped_frames_++;
+        }
+    }
+
+    /**
+     * @brief Segment size of a GRO read (the whole read if it was not coalesced).
+     */
+    static size_t gro_segment_size(struct msghdr& hdr, size_t len) {
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+            if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+                int gso_size = 0;
+                std::memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+                if (gso_size > 0) return static_cast<size_t>(gso_size);
             }
         }
+        return len;
+    }
+
+    /**
+     * @brief Retransmission: every half NACK delay, send the NACKs that are due, one
+     * datagram per frame (see UdpReassembler::poll_nack()).
+     * Flow control: repeat the grant every credit_interval_ms_ (lost ones are made up for).
+     */
+    void feedback_loop() {
+        int period_ms = nack_delay_ms_ >= 2 ? nack_delay_ms_ / 2 : 1;
+        if (nack_delay_ms_ < 0 || (credit_interval_ms_ >= 0 && credit_interval_ms_ < period_ms))
+            period_ms = credit_interval_ms_;
+        FragmentRange missing[SPU_UDP_NACK_MAX_RANGES];
+        uint8_t datagram[sizeof(SpuNackHeader) + SPU_UDP_NACK_MAX_RANGES * sizeof(SpuNackRange)];
+        auto next_credit = std::chrono::steady_clock::now();
 
-        if (data_available) {
-            std::vector<uint8_t> frame = std::move(completed_frames_.front());
-            completed_frames_.pop();
-            return frame;
+        while (running_) {
+            if (credit_interval_ms_ >= 0 && std::chrono::steady_clock::now() >= next_credit) {
+                send_credit();
+                next_credit = std::chrono::steady_clock::now() + std::chrono::milliseconds(credit_interval_ms_);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(period_ms));
+            if (nack_delay_ms_ < 0) continue;
+            for (auto& shard : shards_) {
+                std::lock_guard<std::mutex> target_lock(shard->target_mutex);
+                uint32_t frame_id;
+                size_t count;
+                for (size_t f = 0; f < NACK_MAX_FRAMES &&
+                     (count = shard->reassembler.poll_nack(frame_id, missing, SPU_UDP_NACK_MAX_RANGES)) > 0; ++f) {
+                    SpuNackHeader header = {SPU_UDP_NACK_MAGIC, SPU_UDP_VERSION_2, 0, static_cast<uint16_t>(count), frame_id};
+                    std::memcpy(datagram, &header, sizeof(header));
+                    for (size_t r = 0; r < count; ++r) {
+                        SpuNackRange range = {missing[r].first, missing[r].count};
+                        std::memcpy(datagram + sizeof(header) + r * sizeof(range), &range, sizeof(range));
+                    }
+                    const auto* dest = shard->socket.get_dest_addr();
+                    if (sendto(shard->socket.get_fd(), datagram, sizeof(header) + count * sizeof(SpuNackRange), 0,
+                               reinterpret_cast<const struct sockaddr*>(dest), sizeof(*dest)) >= 0)
+                        nacks_sent_++;
+                }
+            }
         }
-        return {};
     }
 
-private:
-void receive_loop() {
+    /**
+     * @brief Nothing received: drop the timed out frames (add_fragment() only does it on traffic).
+     */
+    void expire_frames(Shard& shard) {
+        std::lock_guard<std::mutex> target_lock(shard.target_mutex);
+        shard.reassembler.expire_frames();
+    }
+
+    void receive_loop(Shard& shard) {
+        if (rx_mode_ == RxMode::SCATTER) {
+            receive_loop_scatter(shard);
+            return;
+        }
+        if (rx_mode_ == RxMode::IO_URING && receive_loop_io_uring(shard)) return;
+        if (rx_mode_ == RxMode::XDP) {
+            receive_loop_xdp(shard);
+            return;
+        }
+        if (rx_mode_ == RxMode::PACKET_MMAP) {
+            receive_loop_packet(shard);
+            return;
+        }
+
         const int BATCH_SIZE = 64;
 
+        bool gro = false;
+        if (rx_mode_ == RxMode::GRO) {
+            gro = shard.socket.enable_gro();
+            if (!gro) std::cerr << "[WARNING] UdpSource: UDP_GRO not supported, using plain recvmmsg" << std::endl;
+        }
+        size_t buffer_size = rx_buffer_size_;
+        if (gro) buffer_size = GRO_BUFFER_SIZE;
+        const size_t control_size = CMSG_SPACE(sizeof(int));
+
         struct mmsghdr msgs[BATCH_SIZE];
         struct iovec iovecs[BATCH_SIZE];
-        std::vector<uint8_t> rx_buffer_pool(BATCH_SIZE * RX_BUFFER_SIZE);
+        std::vector<uint8_t> rx_buffer_pool(BATCH_SIZE * buffer_size);
+        std::vector<uint8_t> control_pool(gro ? BATCH_SIZE * control_size : 0);
+
+        // Fragments of one batch (a GRO read holds several), added in one call
+        std::vector<ReassemblyFragment> fragments;
+        std::vector<ReassemblyResult> completed;
+        fragments.reserve(BATCH_SIZE * (buffer_size / (sizeof(SpuUdpHeader) + SPU_UDP_MAX_PAYLOAD) + 1));
 
         for (int i = 0; i < BATCH_SIZE; ++i) {
             std::memset(&iovecs[i], 0, sizeof(struct iovec));
             std::memset(&msgs[i], 0, sizeof(struct mmsghdr));
-            iovecs[i].iov_base = &rx_buffer_pool[i * RX_BUFFER_SIZE];
-            iovecs[i].iov_len = RX_BUFFER_SIZE;
+            iovecs[i].iov_base = &rx_buffer_pool[i * buffer_size];
+            iovecs[i].iov_len = buffer_size;
             msgs[i].msg_hdr.msg_iov = &iovecs[i];
             msgs[i].msg_hdr.msg_iovlen = 1;
         }
 
-        int fd = socket_.get_fd();
+        int fd = shard.socket.get_fd();
 
         while (running_) {
             struct timespec timeout;
             timeout.tv_sec = 1;
             timeout.tv_nsec = 0;
 
+            if (gro) {
+                // The kernel overwrites msg_controllen on every read
+                for (int i = 0; i < BATCH_SIZE; ++i) {
+                    msgs[i].msg_hdr.msg_control = &control_pool[i * control_size];
+                    msgs[i].msg_hdr.msg_controllen = control_size;
+                }
+            }
+
             int retval = recvmmsg(fd, msgs, BATCH_SIZE, 0, &timeout);
 
             if (retval < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    expire_frames(shard);
+                    continue;
+                }
                 perror("UdpSource: recvmmsg failed");
                 break;
             }
-            if (retval == 0) continue;
+            if (retval == 0) {
+                expire_frames(shard);
+                continue;
+            }
 
+            fragments.clear();
             for (int i = 0; i < retval; ++i) {
                 size_t len = msgs[i].msg_len;
+                if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) continue; // Larger than the buffer: dropped
 
-                // Sanity check with updated header size
-                if (len < sizeof(SpuUdpHeader)) continue;
+                uint8_t* pkt_data = &rx_buffer_pool[i * buffer_size];
 
-                uint8_t* pkt_data = &rx_buffer_pool[i * RX_BUFFER_SIZE];
+                // A coalesced read is a train of datagrams of 'segment' bytes (the last may be shorter)
+                size_t segment = gro ? gro_segment_size(msgs[i].msg_hdr, len) : len;
 
-                // Cast to new Header type
-                const SpuUdpHeader* header = reinterpret_cast<const SpuUdpHeader*>(pkt_data);
-                const uint8_t* payload = pkt_data + sizeof(SpuUdpHeader);
+                for (size_t pos = 0; pos < len; pos += segment) {
+                    size_t seg_len = std::min(segment, len - pos);
 
-                auto result = reassembler_.add_fragment(*header, payload, len - sizeof(SpuUdpHeader));
+                    // Sanity check: runt datagram (shorter than its header)
+                    ReassemblyFragment fragment;
+                    if (!spu_udp_parse(pkt_data + pos, seg_len, fragment.info)) break;
+                    fragment.payload = pkt_data + pos + fragment.info.header_size;
+                    fragment.payload_len = seg_len - fragment.info.header_size;
+                    fragments.push_back(fragment);
+                }
+                msgs[i].msg_len = 0;
+            }
+
+            std::lock_guard<std::mutex> target_lock(shard.target_mutex);
+            completed.clear();
+            shard.reassembler.add_fragments(fragments.data(), fragments.size(), completed);
+            for (auto& result : completed) handle_result(shard, result);
+        }
+    }
+
+    /**
+     * @brief Scatter receive: each mmsghdr has three iovecs, the SPU header goes to a
+     * side array and the payload directly to the slot predicted by the reassembler
+     * (anything beyond the predicted room spills into the bounce buffer).
+     *
+     * Mispredicted payloads are first moved to their bounce buffer (pass 1), then
+     * correctly placed fragments are committed in place (pass 2) and finally the
+     * bounced ones are added with a copy (pass 3). Predicted slots are never received
+     * ones, so a mispredicted write can only land in a hole that is filled later.
+     * The header iovec has the length of the last header received (v1 or v2): a datagram
+     * with another header length is put back together and bounced.
+     * The target lock is held across recvmmsg (the kernel may write into the target),
+     * so the socket is read with MSG_DONTWAIT and waited on with poll() without the lock.
+     */
+    void receive_loop_scatter(Shard& shard) {
+        const int BATCH_SIZE = 64;
+        const size_t rx_size = rx_buffer_size_;
 
-                if (result.complete) {
-                    {
-                        std::lock_guard<std::mutex> lock(queue_mutex_);
-                        completed_frames_.push(std::move(result.data));
+        struct mmsghdr msgs[BATCH_SIZE];
+        struct iovec iovecs[BATCH_SIZE][3];
+        uint8_t headers[BATCH_SIZE][SPU_UDP_V2_HEADER_SIZE];
+        SpuFragmentInfo infos[BATCH_SIZE];
+        size_t payload_lens[BATCH_SIZE];
+        ReassemblyPrediction predictions[BATCH_SIZE];
+        bool valid[BATCH_SIZE];
+        bool in_place[BATCH_SIZE];
+        std::vector<uint8_t> bounce_pool(BATCH_SIZE * rx_size);
+        std::vector<uint8_t> datagram(SPU_UDP_V2_HEADER_SIZE + rx_size);
+
+        std::memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < BATCH_SIZE; ++i) {
+            iovecs[i][0].iov_base = headers[i];
+            msgs[i].msg_hdr.msg_iov = iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 3;
+        }
+
+        int fd = shard.socket.get_fd();
+        SpuUdpHeader none = {0, 0, 0};
+        SpuFragmentInfo last = spu_udp_info(none); // No prediction until the first fragment
+        size_t header_len = sizeof(SpuUdpHeader);
+
+        while (running_) {
+            std::unique_lock<std::mutex> target_lock(shard.target_mutex);
+
+            shard.reassembler.predict_slots(last, predictions, BATCH_SIZE);
+            for (int i = 0; i < BATCH_SIZE; ++i) {
+                uint8_t* bounce = &bounce_pool[i * rx_size];
+                if (predictions[i].slot != nullptr && predictions[i].len > rx_size)
+                    predictions[i].slot = nullptr; // Could not be evacuated to the bounce buffer
+                size_t room = predictions[i].slot ? predictions[i].len : 0;
+                iovecs[i][0].iov_len = header_len;
+                iovecs[i][1].iov_base = predictions[i].slot ? predictions[i].slot : bounce;
+                iovecs[i][1].iov_len = predictions[i].slot ? room : rx_size;
+                iovecs[i][2].iov_base = bounce;
+                iovecs[i][2].iov_len = predictions[i].slot ? rx_size - room : 0;
+                msgs[i].msg_hdr.msg_flags = 0;
+            }
+
+            int retval = recvmmsg(fd, msgs, BATCH_SIZE, MSG_DONTWAIT, nullptr);
+
+            if (retval < 0) {
+                shard.reassembler.end_commit();
+                target_lock.unlock();
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    struct pollfd pfd = {fd, POLLIN, 0};
+                    if (poll(&pfd, 1, 100) == 0) expire_frames(shard);
+                    continue;
+                }
+                perror("UdpSource: recvmmsg failed");
+                break;
+            }
+
+            // Pass 1: classify, and evacuate mispredicted payloads before anything is committed
+            for (int i = 0; i < retval; ++i) {
+                size_t len = msgs[i].msg_len;
+                uint8_t* bounce = &bounce_pool[i * rx_size];
+                uint8_t* slot = predictions[i].slot;
+                size_t room = slot ? predictions[i].len : 0;
+                valid[i] = false;
+                in_place[i] = false;
+                if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) continue; // Oversized datagram: dropped
+
+                size_t head = std::min(len, header_len);
+                if (len >= header_len && spu_udp_header_size(headers[i], head) == header_len) {
+                    spu_udp_parse(headers[i], header_len, infos[i]);
+                    size_t payload_len = len - header_len;
+                    if (slot != nullptr) {
+                        if (infos[i].frame_id == predictions[i].frame_id &&
+                            infos[i].frag_index == predictions[i].frag_index && payload_len <= room) {
+                            in_place[i] = true;
+                        } else {
+                            // The spilled tail is already at the start of the bounce buffer
+                            size_t in_slot = std::min(payload_len, room);
+                            std::memmove(bounce + in_slot, bounce, payload_len - in_slot);
+                            std::memcpy(bounce, slot, in_slot);
+                        }
                     }
-                    queue_cv_.notify_one();
+                    payload_lens[i] = payload_len;
+                } else {
+                    // Header of another length (the sender switched versions): reassemble the datagram
+                    size_t in_slot = std::min(len - head, room);
+                    std::memcpy(&datagram[0], headers[i], head);
+                    if (in_slot > 0) std::memcpy(&datagram[head], slot, in_slot);
+                    std::memcpy(&datagram[head + in_slot], bounce, len - head - in_slot);
+                    if (!spu_udp_parse(datagram.data(), len, infos[i])) continue; // Runt datagram: dropped
+                    payload_lens[i] = len - infos[i].header_size;
+                    if (payload_lens[i] > rx_size) continue;
+                    std::memcpy(bounce, &datagram[infos[i].header_size], payload_lens[i]);
                 }
-                msgs[i].msg_len = 0;
+                valid[i] = true;
+            }
+
+            // Pass 2: fragments already at their final place
+            for (int i = 0; i < retval; ++i) {
+                if (!in_place[i]) continue;
+                auto result = shard.reassembler.commit_fragment(infos[i], predictions[i].slot, payload_lens[i]);
+                handle_result(shard, result);
             }
+            shard.reassembler.end_commit();
+
+            // Pass 3: bounced fragments
+            for (int i = 0; i < retval; ++i) {
+                if (in_place[i] || !valid[i]) continue;
+                auto result = shard.reassembler.add_fragment(infos[i], &bounce_pool[i * rx_size],
+                                                             payload_lens[i]);
+                handle_result(shard, result);
+            }
+
+            for (int i = retval - 1; i >= 0; --i) {
+                if (!valid[i]) continue;
+                last = infos[i];
+                header_len = std::min(static_cast<size_t>(last.header_size), sizeof(headers[i]));
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief io_uring receive: a single multishot IORING_OP_RECV keeps posting one CQE
+     * per datagram, each landing in a buffer picked by the kernel from a provided-buffer
+     * ring. No syscall per batch besides the wait, no per-read buffer setup.
+     * Buffers go back to the ring as soon as their fragment has been added.
+     * @return false if io_uring is unavailable (the caller falls back to recvmmsg).
+     */
+    bool receive_loop_io_uring(Shard& shard) {
+        const uint16_t BUFFER_GROUP = 0;
+        const uint64_t RECV_TAG = 1;
+
+        // A recv into a provided buffer truncates silently: one spare byte tells a datagram
+        // larger than rx_buffer_size_ (dropped)
+        const size_t rx_size = rx_buffer_size_;
+        const size_t stride = rx_size + 1;
+        unsigned buffer_count = URING_MAX_BUFFERS;
+        while (buffer_count > URING_MIN_BUFFERS && buffer_count * stride > URING_BUFFER_BYTES) buffer_count >>= 1;
+
+        // Declared first: must outlive the ring, the kernel writes into it
+        std::vector<uint8_t> rx_buffer_pool(buffer_count * stride);
+        std::unique_ptr<IoUring> ring;
+        std::unique_ptr<IoUringBufRing> buf_ring;
+        try {
+            ring.reset(new IoUring(8, 2 * buffer_count));
+            buf_ring.reset(new IoUringBufRing(*ring, buffer_count, BUFFER_GROUP));
+        } catch (const std::runtime_error& e) {
+            std::cerr << "[WARNING] UdpSource: " << e.what() << ", using plain recvmmsg" << std::endl;
+            return false;
+        }
+        if ((ring->get_features() & IORING_FEAT_EXT_ARG) == 0) {
+            std::cerr << "[WARNING] UdpSource: io_uring too old (no EXT_ARG), using plain recvmmsg" << std::endl;
+            return false;
+        }
+
+        for (unsigned i = 0; i < buffer_count; ++i)
+            buf_ring->add(&rx_buffer_pool[i * stride], stride, static_cast<uint16_t>(i));
+        buf_ring->publish();
+
+        int fd = shard.socket.get_fd();
+        bool armed = false;
+        bool need_submit = false;  // A (re-)armed recv waits in the SQ
+
+        while (running_) {
+            if (!armed) {
+                struct io_uring_sqe* sqe = ring->get_sqe();
+                sqe->opcode = IORING_OP_RECV;
+                sqe->fd = fd;
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = BUFFER_GROUP;
+                sqe->user_data = RECV_TAG;
+                armed = true;
+                need_submit = true;
+            }
+
+            // Steady state: completions are already there, no syscall at all
+            if (ring->peek_cqe() == nullptr || need_submit) {
+                int ret = ring->submit(1, 100);
+                need_submit = false;
+                if (ret < 0 && ret != -ETIME && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+                    errno = -ret;
+                    perror("UdpSource: io_uring_enter failed");
+                    break;
+                }
+                if (ring->peek_cqe() == nullptr) {
+                    expire_frames(shard);
+                    continue;
+                }
+            }
+
+            std::lock_guard<std::mutex> target_lock(shard.target_mutex);
+            struct io_uring_cqe* cqe;
+            unsigned seen = 0;
+            while ((cqe = ring->peek_cqe()) != nullptr) {
+                int res = cqe->res;
+                unsigned flags = cqe->flags;
+                ring->cq_advance();
+                seen++;
+
+                // The multishot request ended (ring ran dry, CQ overflow, error): re-arm it
+                if ((flags & IORING_CQE_F_MORE) == 0) armed = false;
+
+                if (res < 0) {
+                    if (res != -ENOBUFS && res != -ECANCELED && res != -EINTR) {
+                        errno = -res;
+                        perror("UdpSource: io_uring recv failed");
+                    }
+                    continue;
+                }
+                if ((flags & IORING_CQE_F_BUFFER) == 0) continue;
+
+                uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+                uint8_t* pkt_data = &rx_buffer_pool[bid * stride];
+                size_t len = static_cast<size_t>(res);
+                SpuFragmentInfo info;
+                if (len <= rx_size && spu_udp_parse(pkt_data, len, info)) {
+                    auto result = shard.reassembler.add_fragment(info, pkt_data + info.header_size,
+                                                                 len - info.header_size);
+                    handle_result(shard, result);
+                }
+                buf_ring->add(pkt_data, stride, bid);
+            }
+            if (seen > 0) buf_ring->publish();
+        }
+        return true;
+    }
+
+    /**
+     * @brief XDP Mode: attach the redirect program and open one AF_XDP socket per shard.
+     * Falls back to RECVMMSG (with a warning) if any step fails.
+     */
+    void open_xdp() {
+        if (ifname_.empty()) {
+            std::cerr << "[WARNING] UdpSource: no AF_XDP interface set, using plain recvmmsg" << std::endl;
+            rx_mode_ = RxMode::RECVMMSG;
+            return;
+        }
+        try {
+            xdp_program_.reset(new XdpProgram(ifname_, listen_port_, static_cast<unsigned>(shards_.size())));
+            for (auto& shard : shards_) {
+                shard->xsk.reset(new XdpSocket(ifname_, shard->index, XDP_RX_FRAMES, 0));
+                if (!xdp_program_->add_socket(shard->index, shard->xsk->get_fd()))
+                    throw std::runtime_error(std::string("cannot register the AF_XDP socket (") + std::strerror(errno) + ")");
+            }
+        } catch (const std::runtime_error& e) {
+            std::cerr << "[WARNING] UdpSource: " << e.what() << ", using plain recvmmsg" << std::endl;
+            for (auto& shard : shards_) shard->xsk.reset();
+            xdp_program_.reset();
+            rx_mode_ = RxMode::RECVMMSG;
+        }
+    }
+
+    /**
+     * @brief PACKET_MMAP Mode: open one ring per shard (a fanout group by frame_id if
+     * there are several: without it every ring would see every packet).
+     * Falls back to RECVMMSG (with a warning) if any step fails.
+     */
+    void open_packet_rings() {
+        if (ifname_.empty()) {
+            std::cerr << "[WARNING] UdpSource: no capture interface set, using plain recvmmsg" << std::endl;
+            rx_mode_ = RxMode::RECVMMSG;
+            return;
+        }
+        try {
+            for (auto& shard : shards_) {
+                shard->packet_ring.reset(new PacketRing(ifname_, listen_port_));
+                if (shards_.size() > 1 &&
+                    !shard->packet_ring->join_fanout(listen_port_, static_cast<uint32_t>(shards_.size())))
+                    throw std::runtime_error(std::string("PACKET_FANOUT_CBPF unavailable (") + std::strerror(errno) + ")");
+            }
+        } catch (const std::runtime_error& e) {
+            std::cerr << "[WARNING] UdpSource: " << e.what() << ", using plain recvmmsg" << std::endl;
+            for (auto& shard : shards_) shard->packet_ring.reset();
+            rx_mode_ = RxMode::RECVMMSG;
+            return;
+        }
+        // The socket stays bound (no ICMP port unreachable) but the stack still delivers
+        // (and then drops) its own copy of every packet: keep that buffer minimal.
+        for (auto& shard : shards_) shard->socket.set_recv_buffer(0);
+    }
+
+    /**
+     * @brief AF_XDP receive: frames arrive in the UMEM through the RX ring, the
+     * Ethernet/IPv4/UDP headers are parsed here and the SPU fragment is added.
+     * Frames go straight back to the fill ring; no syscall while packets keep coming.
+     */
+    void receive_loop_xdp(Shard& shard) {
+        XdpSocket* xsk = shard.xsk.get();
+        const uint16_t port = listen_port_;
+        while (running_) {
+            unsigned count;
+            {
+                std::lock_guard<std::mutex> target_lock(shard.target_mutex);
+                count = xsk->receive(XDP_BATCH_SIZE, [this, &shard, port](const uint8_t* frame, size_t len) {
+                    const uint8_t* payload;
+                    size_t payload_len;
+                    if (!EthIpv4Udp::parse(frame, len, port, payload, payload_len)) return;
+                    SpuFragmentInfo info;
+                    if (!spu_udp_parse(payload, payload_len, info)) return;
+                    auto result = shard.reassembler.add_fragment(info, payload + info.header_size,
+                                                                 payload_len - info.header_size);
+                    handle_result(shard, result);
+                });
+            }
+            if (count == 0 && !xsk->wait_rx(100)) expire_frames(shard);
+        }
+    }
+
+    /**
+     * @brief PACKET_MMAP receive: whole blocks of packets are read from the shared ring,
+     * headers parsed here, payloads added to the reassembler; poll() only when idle.
+     */
+    void receive_loop_packet(Shard& shard) {
+        PacketRing* ring = shard.packet_ring.get();
+        const uint16_t port = listen_port_;
+        while (running_) {
+            unsigned count;
+            {
+                std::lock_guard<std::mutex> target_lock(shard.target_mutex);
+                count = ring->receive(PACKET_BATCH_BLOCKS, [this, &shard, port](const uint8_t* frame, size_t len) {
+                    const uint8_t* payload;
+                    size_t payload_len;
+                    if (!EthIpv4Udp::parse(frame, len, port, payload, payload_len)) return;
+                    SpuFragmentInfo info;
+                    if (!spu_udp_parse(payload, payload_len, info)) return;
+                    auto result = shard.reassembler.add_fragment(info, payload + info.header_size,
+                                                                 payload_len - info.header_size);
+                    handle_result(shard, result);
+                });
+            }
+            if (count == 0 && !ring->wait(100)) expire_frames(shard);
         }
     }
 };
 
+typedef BasicUdpSource<> UdpSource;
+
+/**
+ * @brief Source of a stream whose payload size (and frame size) is known at compile time.
+ */
+template <size_t PayloadSize, size_t FrameSize = 0>
+using FixedUdpSource = BasicUdpSource<FixedUdpReassembler<PayloadSize, FrameSize>>;
+
 #endif // UDP_SOURCE_HPP
\ No newline at end of file
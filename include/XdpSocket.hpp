@@ -0,0 +1,459 @@
+/**
+ * @file XdpSocket.hpp
+ * @brief AF_XDP (kernel bypass) building blocks, without libbpf/libxdp.
+ *
+ * XdpProgram loads a small XDP program that redirects the SPU UDP port to an
+ * XSKMAP and attaches it to an interface (generic/SKB mode by default, so it
+ * works on veth or any NIC). XdpSocket owns one AF_XDP socket: its UMEM and the
+ * fill/completion/RX/TX rings. Frames are parsed/built with EthIpv4Udp.
+ */
+
+#ifndef XDP_SOCKET_HPP
+#define XDP_SOCKET_HPP
+
+#include "EthIpv4Udp.hpp"
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/**
+ * @brief XDP program + XSKMAP: redirects IPv4/UDP packets for 'udp_port' to the
+ * AF_XDP socket registered for their RX queue, everything else goes to the stack.
+ * Detached when destroyed (the program is held by a BPF link).
+ */
+class XdpProgram {
+private:
+    int map_fd_ = -1;
+    int prog_fd_ = -1;
+    int link_fd_ = -1;
+    unsigned ifindex_;
+
+    static long bpf(int cmd, union bpf_attr* attr) {
+        return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+    }
+
+    static struct bpf_insn insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+        struct bpf_insn i;
+        i.code = code;
+        i.dst_reg = dst;
+        i.src_reg = src;
+        i.off = off;
+        i.imm = imm;
+        return i;
+    }
+
+    void release() {
+        if (link_fd_ >= 0) close(link_fd_);
+        if (prog_fd_ >= 0) close(prog_fd_);
+        if (map_fd_ >= 0) close(map_fd_);
+        link_fd_ = prog_fd_ = map_fd_ = -1;
+    }
+
+    [[noreturn]] void fail(const std::string& what) {
+        std::string msg = "XdpProgram: " + what + " (" + std::strerror(errno) + ")";
+        release();
+        throw std::runtime_error(msg);
+    }
+
+public:
+    /**
+     * @param ifname Interface to attach to.
+     * @param udp_port Destination port of the SPU traffic.
+     * @param max_queues XSKMAP size (RX queues that may get a socket).
+     * @param generic Generic (SKB) XDP, works on any device; false: native driver mode.
+     * @throws std::runtime_error (unknown interface, no CAP_BPF/CAP_NET_ADMIN, kernel < 5.9).
+     */
+    XdpProgram(const std::string& ifname, uint16_t udp_port, unsigned max_queues = 64, bool generic = true) {
+        ifindex_ = if_nametoindex(ifname.c_str());
+        if (ifindex_ == 0) throw std::runtime_error("XdpProgram: unknown interface " + ifname);
+
+        union bpf_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.map_type = BPF_MAP_TYPE_XSKMAP;
+        attr.key_size = sizeof(uint32_t);
+        attr.value_size = sizeof(uint32_t);
+        attr.max_entries = max_queues;
+        map_fd_ = static_cast<int>(bpf(BPF_MAP_CREATE, &attr));
+        if (map_fd_ < 0) fail("cannot create the XSKMAP");
+
+        // r6 = ctx; bounds-check 42 bytes, then match IPv4 (IHL 5, not fragmented), UDP, dport.
+        // LE host: 16-bit loads of big endian fields are compared against byte-swapped constants.
+        const int16_t PASS = -1; // Patched below
+        std::vector<struct bpf_insn> code;
+        std::vector<size_t> to_pass;
+        code.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0));
+        code.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(struct xdp_md, data), 0));
+        code.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, 3, 1, offsetof(struct xdp_md, data_end), 0));
+        code.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0));
+        code.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, static_cast<int32_t>(EthIpv4Udp::HEADERS_LEN)));
+        to_pass.push_back(code.size());
+        code.push_back(insn(BPF_JMP | BPF_JGT | BPF_X, 4, 3, PASS, 0));
+        code.push_back(insn(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 12, 0));                                  // EtherType
+        to_pass.push_back(code.size());
+        code.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS, htons(ETH_P_IP)));
+        code.push_back(insn(BPF_LDX | BPF_MEM | BPF_B, 5, 2, EthIpv4Udp::ETH_HEADER_LEN, 0));                // Version/IHL
+        to_pass.push_back(code.size());
+        code.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS, 0x45));
+        code.push_back(insn(BPF_LDX | BPF_MEM | BPF_H, 5, 2, EthIpv4Udp::ETH_HEADER_LEN + 6, 0));            // MF + frag offset
+        code.push_back(insn(BPF_ALU64 | BPF_AND | BPF_K, 5, 0, 0, htons(0x3fff)));
+        to_pass.push_back(code.size());
+        code.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS, 0));
+        code.push_back(insn(BPF_LDX | BPF_MEM | BPF_B, 5, 2, EthIpv4Udp::ETH_HEADER_LEN + 9, 0));            // Protocol
+        to_pass.push_back(code.size());
+        code.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS, IPPROTO_UDP));
+        code.push_back(insn(BPF_LDX | BPF_MEM | BPF_H, 5, 2, EthIpv4Udp::ETH_HEADER_LEN + EthIpv4Udp::IP_HEADER_LEN + 2, 0)); // Dest port
+        to_pass.push_back(code.size());
+        code.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PASS, htons(udp_port)));
+        // return bpf_redirect_map(&xskmap, ctx->rx_queue_index, XDP_PASS)
+        code.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, 2, 6, offsetof(struct xdp_md, rx_queue_index), 0));
+        code.push_back(insn(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd_));
+        code.push_back(insn(0, 0, 0, 0, 0));
+        code.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS));
+        code.push_back(insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+        code.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+        const size_t pass = code.size();
+        code.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS));
+        code.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+        for (size_t at : to_pass) code[at].off = static_cast<int16_t>(pass - at - 1);
+
+        static const char license[] = "GPL";
+        std::memset(&attr, 0, sizeof(attr));
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.insns = reinterpret_cast<uint64_t>(code.data());
+        attr.insn_cnt = static_cast<uint32_t>(code.size());
+        attr.license = reinterpret_cast<uint64_t>(license);
+        prog_fd_ = static_cast<int>(bpf(BPF_PROG_LOAD, &attr));
+        if (prog_fd_ < 0) fail("cannot load the XDP program");
+
+        std::memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd = static_cast<uint32_t>(prog_fd_);
+        attr.link_create.target_ifindex = ifindex_;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = generic ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+        link_fd_ = static_cast<int>(bpf(BPF_LINK_CREATE, &attr));
+        if (link_fd_ < 0) fail("cannot attach the XDP program to " + ifname);
+    }
+
+    ~XdpProgram() { release(); }
+
+    XdpProgram(const XdpProgram&) = delete;
+    XdpProgram& operator=(const XdpProgram&) = delete;
+
+    unsigned get_ifindex() const { return ifindex_; }
+
+    /**
+     * @brief Route the packets of RX queue 'queue' to the AF_XDP socket 'xsk_fd'.
+     * @return false on failure (errno set).
+     */
+    bool add_socket(uint32_t queue, int xsk_fd) {
+        uint32_t value = static_cast<uint32_t>(xsk_fd);
+        union bpf_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.map_fd = static_cast<uint32_t>(map_fd_);
+        attr.key = reinterpret_cast<uint64_t>(&queue);
+        attr.value = reinterpret_cast<uint64_t>(&value);
+        return bpf(BPF_MAP_UPDATE_ELEM, &attr) == 0;
+    }
+};
+
+/**
+ * @brief One AF_XDP socket bound to (interface, queue), with its own UMEM.
+ * RX frames live in the fill ring until the kernel hands them back on the RX
+ * ring; TX frames come from a free list and return via the completion ring.
+ */
+class XdpSocket {
+private:
+    // Single-producer/single-consumer ring shared with the kernel
+    struct Ring {
+        uint32_t* producer = nullptr;
+        uint32_t* consumer = nullptr;
+        uint32_t* flags = nullptr;
+        void* descs = nullptr;
+        uint32_t mask = 0;
+        uint32_t cached = 0;       // Local producer (we produce) or consumer (we consume)
+        void* map = MAP_FAILED;
+        size_t map_size = 0;
+
+        uint64_t* addrs() { return static_cast<uint64_t*>(descs); }
+        struct xdp_desc* xdp_descs() { return static_cast<struct xdp_desc*>(descs); }
+    };
+
+    int fd_ = -1;
+    uint8_t* umem_ = static_cast<uint8_t*>(MAP_FAILED);
+    size_t umem_size_ = 0;
+    uint32_t frame_size_;
+    Ring fill_, comp_, rx_, tx_;
+    std::vector<uint64_t> tx_free_;     // UMEM addresses available for transmission
+    uint32_t tx_outstanding_ = 0;       // Queued on the TX ring, not completed yet
+
+    static const uint32_t MIN_RING = 64;
+
+    void setup_ring(int opt, uint32_t entries) {
+        if (setsockopt(fd_, SOL_XDP, opt, &entries, sizeof(entries)) < 0)
+            fail("cannot size the rings");
+    }
+
+    void map_ring(Ring& ring, const struct xdp_ring_offset& off, uint32_t entries, size_t desc_size, uint64_t pgoff) {
+        ring.map_size = off.desc + entries * desc_size;
+        ring.map = mmap(nullptr, ring.map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, pgoff);
+        if (ring.map == MAP_FAILED) fail("cannot map a ring");
+        uint8_t* base = static_cast<uint8_t*>(ring.map);
+        ring.producer = reinterpret_cast<uint32_t*>(base + off.producer);
+        ring.consumer = reinterpret_cast<uint32_t*>(base + off.consumer);
+        ring.flags = reinterpret_cast<uint32_t*>(base + off.flags);
+        ring.descs = base + off.desc;
+        ring.mask = entries - 1;
+    }
+
+    void release() {
+        Ring* rings[] = {&fill_, &comp_, &rx_, &tx_};
+        for (Ring* ring : rings)
+            if (ring->map != MAP_FAILED) munmap(ring->map, ring->map_size);
+        if (fd_ >= 0) close(fd_);
+        if (umem_ != MAP_FAILED) munmap(umem_, umem_size_);
+        fd_ = -1;
+        umem_ = static_cast<uint8_t*>(MAP_FAILED);
+    }
+
+    [[noreturn]] void fail(const std::string& what) {
+        std::string msg = "XdpSocket: " + what + " (" + std::strerror(errno) + ")";
+        release();
+        throw std::runtime_error(msg);
+    }
+
+public:
+    /**
+     * @param rx_frames UMEM frames given to the kernel for reception (0: TX only).
+     * @param tx_frames UMEM frames used for transmission (0: RX only).
+     * @param frame_size UMEM chunk size (power of two, 2048 or 4096).
+     * @param copy_mode Force XDP_COPY (required by generic XDP); false lets the driver pick.
+     * @throws std::runtime_error
+     */
+    XdpSocket(const std::string& ifname, uint32_t queue, uint32_t rx_frames, uint32_t tx_frames,
+              uint32_t frame_size = 2048, bool copy_mode = true)
+    : frame_size_(frame_size) {
+        unsigned ifindex = if_nametoindex(ifname.c_str());
+        if (ifindex == 0) throw std::runtime_error("XdpSocket: unknown interface " + ifname);
+
+        fd_ = socket(AF_XDP, SOCK_RAW, 0);
+        if (fd_ < 0) fail("cannot create the AF_XDP socket");
+
+        umem_size_ = static_cast<size_t>(rx_frames + tx_frames) * frame_size;
+        umem_ = static_cast<uint8_t*>(mmap(nullptr, umem_size_, PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0));
+        if (umem_ == MAP_FAILED) fail("cannot allocate the UMEM");
+
+        struct xdp_umem_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.addr = reinterpret_cast<uint64_t>(umem_);
+        reg.len = umem_size_;
+        reg.chunk_size = frame_size;
+        if (setsockopt(fd_, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) fail("cannot register the UMEM");
+
+        // Ring sizes are powers of two; the fill/completion rings are mandatory even if unused
+        uint32_t fill_entries = MIN_RING, comp_entries = MIN_RING;
+        while (fill_entries < rx_frames) fill_entries <<= 1;
+        while (comp_entries < tx_frames) comp_entries <<= 1;
+        setup_ring(XDP_UMEM_FILL_RING, fill_entries);
+        setup_ring(XDP_UMEM_COMPLETION_RING, comp_entries);
+        if (rx_frames > 0) setup_ring(XDP_RX_RING, fill_entries);
+        if (tx_frames > 0) setup_ring(XDP_TX_RING, comp_entries);
+
+        struct xdp_mmap_offsets off;
+        socklen_t optlen = sizeof(off);
+        if (getsockopt(fd_, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) fail("cannot get the ring offsets");
+        map_ring(fill_, off.fr, fill_entries, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING);
+        map_ring(comp_, off.cr, comp_entries, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING);
+        if (rx_frames > 0) map_ring(rx_, off.rx, fill_entries, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING);
+        if (tx_frames > 0) map_ring(tx_, off.tx, comp_entries, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING);
+
+        // RX frames first in the UMEM, all handed to the kernel; TX frames after them
+        fill_.cached = *fill_.producer;
+        for (uint32_t i = 0; i < rx_frames; ++i)
+            fill_.addrs()[(fill_.cached + i) & fill_.mask] = static_cast<uint64_t>(i) * frame_size;
+        fill_.cached += rx_frames;
+        __atomic_store_n(fill_.producer, fill_.cached, __ATOMIC_RELEASE);
+        for (uint32_t i = 0; i < tx_frames; ++i)
+            tx_free_.push_back(static_cast<uint64_t>(rx_frames + i) * frame_size);
+        comp_.cached = *comp_.consumer;
+        if (rx_frames > 0) rx_.cached = *rx_.consumer;
+        if (tx_frames > 0) tx_.cached = *tx_.producer;
+
+        struct sockaddr_xdp sxdp;
+        std::memset(&sxdp, 0, sizeof(sxdp));
+        sxdp.sxdp_family = AF_XDP;
+        sxdp.sxdp_ifindex = ifindex;
+        sxdp.sxdp_queue_id = queue;
+        sxdp.sxdp_flags = copy_mode ? XDP_COPY : 0;
+        if (bind(fd_, reinterpret_cast<struct sockaddr*>(&sxdp), sizeof(sxdp)) < 0)
+            fail("cannot bind to " + ifname + " queue " + std::to_string(queue));
+    }
+
+    ~XdpSocket() { release(); }
+
+    XdpSocket(const XdpSocket&) = delete;
+    XdpSocket& operator=(const XdpSocket&) = delete;
+
+    int get_fd() const { return fd_; }
+
+    /**
+     * @brief Wait until the RX ring has packets (or timeout). @return true if readable.
+     */
+    bool wait_rx(int timeout_ms) {
+        struct pollfd pfd = {fd_, POLLIN, 0};
+        return poll(&pfd, 1, timeout_ms) > 0;
+    }
+
+    /**
+     * @brief Hand up to 'budget' received packets to on_packet(data, len), then
+     * give their frames back to the fill ring. No syscall.
+     * @return Number of packets processed.
+     */
+    template <typename Callback>
+    unsigned receive(unsigned budget, Callback on_packet) {
+        uint32_t available = __atomic_load_n(rx_.producer, __ATOMIC_ACQUIRE) - rx_.cached;
+        if (available > budget) available = budget;
+        for (uint32_t i = 0; i < available; ++i) {
+            const struct xdp_desc& desc = rx_.xdp_descs()[(rx_.cached + i) & rx_.mask];
+            on_packet(static_cast<const uint8_t*>(umem_ + desc.addr), static_cast<size_t>(desc.len));
+            // The frame's chunk goes back to the kernel (our fill ring never holds more than rx_frames)
+            fill_.addrs()[(fill_.cached + i) & fill_.mask] = desc.addr & ~static_cast<uint64_t>(frame_size_ - 1);
+        }
+        if (available > 0) {
+            rx_.cached += available;
+            __atomic_store_n(rx_.consumer, rx_.cached, __ATOMIC_RELEASE);
+            fill_.cached += available;
+            __atomic_store_n(fill_.producer, fill_.cached, __ATOMIC_RELEASE);
+        }
+        return available;
+    }
+
+    /**
+     * @brief Take a free TX frame (frame_size bytes), or nullptr if all are in flight.
+     */
+    uint8_t* tx_frame() {
+        if (tx_free_.empty()) reap_tx();
+        if (tx_free_.empty()) return nullptr;
+        uint8_t* frame = umem_ + tx_free_.back();
+        tx_free_.pop_back();
+        return frame;
+    }
+
+    /**
+     * @brief Queue a frame obtained from tx_frame() (visible to the kernel after kick()).
+     * The TX ring has at least as many entries as TX frames, so it cannot overflow.
+     */
+    void tx_queue(uint8_t* frame, size_t len) {
+        struct xdp_desc& desc = tx_.xdp_descs()[tx_.cached & tx_.mask];
+        desc.addr = static_cast<uint64_t>(frame - umem_);
+        desc.len = static_cast<uint32_t>(len);
+        desc.options = 0;
+        tx_.cached++;
+        tx_outstanding_++;
+    }
+
+    /**
+     * @brief Publish the queued frames and make the kernel send them.
+     * Copy mode transmits a bounded batch per call, so this loops until the TX ring is drained.
+     * @return false on a fatal error.
+     */
+    bool kick() {
+        __atomic_store_n(tx_.producer, tx_.cached, __ATOMIC_RELEASE);
+        while (__atomic_load_n(tx_.consumer, __ATOMIC_ACQUIRE) != tx_.cached) {
+            if (sendto(fd_, nullptr, 0, MSG_DONTWAIT, nullptr, 0) < 0 &&
+                errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != EINTR) {
+                perror("XdpSocket: TX kick failed");
+                return false;
+            }
+            reap_tx();
+        }
+        reap_tx();
+        return true;
+    }
+
+    /**
+     * @brief Move completed TX frames back to the free list.
+     */
+    void reap_tx() {
+        uint32_t done = __atomic_load_n(comp_.producer, __ATOMIC_ACQUIRE) - comp_.cached;
+        for (uint32_t i = 0; i < done; ++i)
+            tx_free_.push_back(comp_.addrs()[(comp_.cached + i) & comp_.mask]);
+        if (done > 0) {
+            comp_.cached += done;
+            __atomic_store_n(comp_.consumer, comp_.cached, __ATOMIC_RELEASE);
+            tx_outstanding_ -= done;
+        }
+    }
+
+    uint32_t get_tx_outstanding() const { return tx_outstanding_; }
+
+    /**
+     * @brief MAC address of an interface. @return false if unknown.
+     */
+    static bool get_mac(const std::string& ifname, uint8_t mac[6]) {
+        struct ifreq ifr;
+        std::memset(&ifr, 0, sizeof(ifr));
+        std::strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) return false;
+        bool ok = ioctl(fd, SIOCGIFHWADDR, &ifr) == 0;
+        close(fd);
+        if (ok) std::memcpy(mac, ifr.ifr_hwaddr.sa_data, 6);
+        return ok;
+    }
+
+    /**
+     * @brief First IPv4 address of an interface (network order). @return false if none.
+     */
+    static bool get_ipv4(const std::string& ifname, uint32_t& addr) {
+        struct ifreq ifr;
+        std::memset(&ifr, 0, sizeof(ifr));
+        std::strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+        ifr.ifr_addr.sa_family = AF_INET;
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) return false;
+        bool ok = ioctl(fd, SIOCGIFADDR, &ifr) == 0;
+        close(fd);
+        if (ok) addr = reinterpret_cast<struct sockaddr_in*>(&ifr.ifr_addr)->sin_addr.s_addr;
+        return ok;
+    }
+
+    /**
+     * @brief Parse "aa:bb:cc:dd:ee:ff". @return false if malformed.
+     */
+    static bool parse_mac(const std::string& text, uint8_t mac[6]) {
+        unsigned v[6];
+        if (std::sscanf(text.c_str(), "%x:%x:%x:%x:%x:%x", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 6) return false;
+        for (int i = 0; i < 6; ++i) {
+            if (v[i] > 0xff) return false;
+            mac[i] = static_cast<uint8_t>(v[i]);
+        }
+        return true;
+    }
+};
+
+#endif // XDP_SOCKET_HPP
@@ -11,13 +11,17 @@
 #define SPU_UDP_PROTOCOL_H
 
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
 
 // --------------------------------------------------------------------------
 // PROTOCOL CONFIGURATION
 // --------------------------------------------------------------------------
 
 /**
- * @brief Maximum payload size per UDP packet (in bytes).
+ * @brief Payload size per UDP packet (in bytes) of v1 fragments, whose offset is
+ * frag_index * SPU_UDP_MAX_PAYLOAD. Senders default to the path MTU instead when
+ * they can query it (v2 fragments carry their offset).
  *
  * Calculation logic:
  * Standard Ethernet MTU: 1500 bytes
@@ -41,6 +45,17 @@ static const uint32_t SPU_UDP_MAX_PAYLOAD = 1400;
  */
 static const uint64_t SPU_UDP_MAX_FRAME_SIZE = 4294967295UL * SPU_UDP_MAX_PAYLOAD;
 
+/**
+ * @brief Largest UDP payload over IPv4 (65535 - 20 bytes IP - 8 bytes UDP):
+ * header + payload of any fragment.
+ */
+static const size_t SPU_UDP_MAX_DATAGRAM = 65507;
+
+/**
+ * @brief IPv4 (without options) + UDP header bytes in front of each datagram.
+ */
+static const size_t SPU_UDP_IP_OVERHEAD = 28;
+
 
 // --------------------------------------------------------------------------
 // BINARY HEADER STRUCTURE (12 BYTES)
@@ -88,4 +103,338 @@ struct SpuUdpHeader {
 static_assert(sizeof(SpuUdpHeader) == 12,
     "SPU UDP Protocol Error: Header size mismatch! Must be exactly 12 bytes.");
 
+
+// --------------------------------------------------------------------------
+// PROTOCOL V2 HEADER (36 BYTES)
+// --------------------------------------------------------------------------
+
+/**
+ * @brief First 4 bytes of a v2 header: "SPU2" (little endian 0x32555053).
+ *
+ * A v1 header starts with its frame_id, so a v2 header is only recognised when the
+ * magic, the version and a plausible header_size all match (see spu_udp_parse()).
+ */
+static const uint32_t SPU_UDP_V2_MAGIC = 0x32555053;
+static const uint8_t SPU_UDP_VERSION_1 = 1;
+static const uint8_t SPU_UDP_VERSION_2 = 2;
+
+#pragma pack(push, 1)
+
+struct SpuUdpHeaderV2 {
+    uint32_t magic;         // SPU_UDP_V2_MAGIC
+    uint8_t version;        // SPU_UDP_VERSION_2
+
+    /**
+     * @brief Feature flags (SPU_UDP_FLAG_*): receivers ignore the bits they do not know.
+     */
+    uint8_t flags;
+
+    /**
+     * @brief Bytes from the start of the header to the payload (>= 36).
+     * Later extensions append fields; older receivers skip them.
+     */
+    uint16_t header_size;
+
+    uint32_t frame_id;      // Same meaning as in SpuUdpHeader
+    uint32_t frag_index;
+    uint32_t total_frags;
+
+    /**
+     * @brief Exact size of the whole frame in bytes: known from the first fragment received.
+     */
+    uint64_t frame_size;
+
+    /**
+     * @brief Position of this fragment's payload in the frame. Fragments need not
+     * all have the same size.
+     */
+    uint64_t offset;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(SpuUdpHeaderV2) == 36,
+    "SPU UDP Protocol Error: v2 header size mismatch! Must be exactly 36 bytes.");
+
+static const size_t SPU_UDP_V2_HEADER_SIZE = sizeof(SpuUdpHeaderV2);
+
+
+// --------------------------------------------------------------------------
+// FEC PARITY FRAGMENTS (V2)
+// --------------------------------------------------------------------------
+
+/**
+ * @brief v2 flag of a parity fragment: Reed-Solomon parity (see FecCodec) of a block
+ * of data fragments, from which the receiver rebuilds lost ones.
+ *
+ * Data fragments are grouped in blocks of block_len: block b covers the fragments
+ * [b * block_len, min((b + 1) * block_len, total_frags)) and is followed by its
+ * parity_count parity fragments. A parity fragment has the frame's frame_id,
+ * total_frags and frame_size, frag_index = first data fragment of its block, and a
+ * payload of the data fragments' stride (shorter ones count as zero padded).
+ * Its offset holds SPU_UDP_PARITY_OFFSET | block_len << 16 | parity_count << 8 | row:
+ * beyond frame_size, so receivers without FEC drop it.
+ */
+static const uint8_t SPU_UDP_FLAG_PARITY = 0x01;
+static const uint64_t SPU_UDP_PARITY_OFFSET = 1ULL << 63;
+
+/**
+ * @brief Largest block_len + parity_count (symbols of GF(2^8)).
+ */
+static const unsigned SPU_UDP_FEC_MAX_SHARDS = 255;
+
+inline uint64_t spu_udp_parity_offset(unsigned block_len, unsigned parity_count, unsigned row) {
+    return SPU_UDP_PARITY_OFFSET | (static_cast<uint64_t>(block_len) << 16) |
+           (static_cast<uint64_t>(parity_count) << 8) | row;
+}
+
+
+// --------------------------------------------------------------------------
+// PARSING (BOTH VERSIONS)
+// --------------------------------------------------------------------------
+
+/**
+ * @brief A received fragment header, whatever its version.
+ */
+struct SpuFragmentInfo {
+    uint32_t frame_id;
+    uint32_t frag_index;
+    uint32_t total_frags;
+    uint8_t version;        // SPU_UDP_VERSION_1 or SPU_UDP_VERSION_2
+    uint8_t flags;          // 0 for v1
+    uint16_t header_size;   // Bytes before the payload
+    uint64_t frame_size;    // v2 only (v1: known once the last fragment arrives)
+    uint64_t offset;        // v1: frag_index * SPU_UDP_MAX_PAYLOAD
+
+    bool has_frame_size() const { return version >= SPU_UDP_VERSION_2; }
+
+    /**
+     * @brief Parity fragment, and its block geometry (see SPU_UDP_FLAG_PARITY).
+     */
+    bool is_parity() const { return version >= SPU_UDP_VERSION_2 && (flags & SPU_UDP_FLAG_PARITY); }
+    unsigned fec_block_len() const { return static_cast<unsigned>(offset >> 16) & 0xFF; }
+    unsigned fec_parity_count() const { return static_cast<unsigned>(offset >> 8) & 0xFF; }
+    unsigned fec_row() const { return static_cast<unsigned>(offset) & 0xFF; }
+};
+
+/**
+ * @brief Fragment info of a v1 header.
+ */
+inline SpuFragmentInfo spu_udp_info(const SpuUdpHeader& header) {
+    SpuFragmentInfo info;
+    info.frame_id = header.frame_id;
+    info.frag_index = header.frag_index;
+    info.total_frags = header.total_frags;
+    info.version = SPU_UDP_VERSION_1;
+    info.flags = 0;
+    info.header_size = sizeof(SpuUdpHeader);
+    info.frame_size = 0;
+    info.offset = static_cast<uint64_t>(header.frag_index) * SPU_UDP_MAX_PAYLOAD;
+    return info;
+}
+
+/**
+ * @brief Header length of the datagram starting at 'data', from its first 'len' bytes
+ * (8 are enough to tell a v2 header, whose length they hold, from a v1 one).
+ */
+inline size_t spu_udp_header_size(const void* data, size_t len) {
+    if (len >= 8) {
+        SpuUdpHeaderV2 v2;
+        std::memcpy(&v2, data, 8);
+        if (v2.magic == SPU_UDP_V2_MAGIC && v2.version == SPU_UDP_VERSION_2 &&
+            v2.header_size >= SPU_UDP_V2_HEADER_SIZE)
+            return v2.header_size;
+    }
+    return sizeof(SpuUdpHeader);
+}
+
+/**
+ * @brief Decode the header at the start of a datagram of 'len' bytes.
+ * @return false if the datagram is too short for its header (the payload starts
+ * at data + info.header_size otherwise).
+ */
+inline bool spu_udp_parse(const void* data, size_t len, SpuFragmentInfo& info) {
+    size_t header_size = spu_udp_header_size(data, len);
+    if (len < header_size) return false;
+
+    if (header_size == sizeof(SpuUdpHeader)) {
+        SpuUdpHeader v1;
+        std::memcpy(&v1, data, sizeof(v1));
+        info = spu_udp_info(v1);
+        return true;
+    }
+
+    SpuUdpHeaderV2 v2;
+    std::memcpy(&v2, data, sizeof(v2));
+    info.frame_id = v2.frame_id;
+    info.frag_index = v2.frag_index;
+    info.total_frags = v2.total_frags;
+    info.version = v2.version;
+    info.flags = v2.flags;
+    info.header_size = v2.header_size;
+    info.frame_size = v2.frame_size;
+    info.offset = v2.offset;
+    return true;
+}
+
+
+// --------------------------------------------------------------------------
+// NACK (RECEIVER -> SENDER)
+// --------------------------------------------------------------------------
+
+/**
+ * @brief First 4 bytes of a NACK datagram: "SPUN" (little endian 0x4E555053).
+ *
+ * With retransmission enabled, the receiver reports the fragments still missing from
+ * a frame that went quiet: a SpuNackHeader followed by range_count SpuNackRange
+ * (runs of frag_index). The sender resends them from the copies of its last frames.
+ */
+static const uint32_t SPU_UDP_NACK_MAGIC = 0x4E555053;
+
+/**
+ * @brief Ranges per NACK datagram (fits a 1500 byte MTU): a frame with more gaps
+ * gets the rest reported by the next NACK.
+ */
+static const size_t SPU_UDP_NACK_MAX_RANGES = 128;
+
+#pragma pack(push, 1)
+
+struct SpuNackHeader {
+    uint32_t magic;         // SPU_UDP_NACK_MAGIC
+    uint8_t version;        // SPU_UDP_VERSION_2
+    uint8_t reserved;
+    uint16_t range_count;
+    uint32_t frame_id;
+};
+
+struct SpuNackRange {
+    uint32_t first;         // First missing frag_index
+    uint32_t count;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(SpuNackHeader) == 12 && sizeof(SpuNackRange) == 8,
+    "SPU UDP Protocol Error: NACK layout mismatch!");
+
+/**
+ * @brief Check a NACK datagram of 'len' bytes and decode its header (the ranges
+ * follow it, unaligned).
+ */
+inline bool spu_udp_parse_nack(const void* data, size_t len, SpuNackHeader& header) {
+    if (len < sizeof(SpuNackHeader)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    return header.magic == SPU_UDP_NACK_MAGIC && header.version == SPU_UDP_VERSION_2 &&
+           header.range_count <= SPU_UDP_NACK_MAX_RANGES &&
+           len >= sizeof(SpuNackHeader) + header.range_count * sizeof(SpuNackRange);
+}
+
+
+// --------------------------------------------------------------------------
+// CREDIT (RECEIVER -> SENDER)
+// --------------------------------------------------------------------------
+
+/**
+ * @brief First 4 bytes of a credit datagram: "SPUC" (little endian 0x43555053).
+ *
+ * With flow control enabled, the receiver grants the sender a window of frames:
+ * frame IDs from next_frame (the next one its consumer takes) up to, not including,
+ * next_frame + frames, holding at most 'bytes' bytes in all. That is what its queues and
+ * reassembly window take in without dropping. Grants are absolute, so repeating them
+ * makes up for lost ones; 'seq' orders those of a receiver 'session'.
+ */
+static const uint32_t SPU_UDP_CREDIT_MAGIC = 0x43555053;
+
+/**
+ * @brief Credit flag: the consumer took no frame yet, the window starts at the sender's
+ * next frame (set once per session).
+ */
+static const uint8_t SPU_UDP_CREDIT_FLAG_ANY_BASE = 0x01;
+
+#pragma pack(push, 1)
+
+struct SpuCreditHeader {
+    uint32_t magic;         // SPU_UDP_CREDIT_MAGIC
+    uint8_t version;        // SPU_UDP_VERSION_2
+    uint8_t flags;          // SPU_UDP_CREDIT_FLAG_*
+    uint16_t reserved;
+    uint32_t session;       // Picked by the receiver at startup
+    uint32_t seq;           // Grant number within the session
+    uint32_t next_frame;
+    uint32_t frames;
+    uint64_t bytes;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(SpuCreditHeader) == 32, "SPU UDP Protocol Error: credit layout mismatch!");
+
+/**
+ * @brief Check a credit datagram of 'len' bytes and decode it.
+ */
+inline bool spu_udp_parse_credit(const void* data, size_t len, SpuCreditHeader& header) {
+    if (len < sizeof(SpuCreditHeader)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    return header.magic == SPU_UDP_CREDIT_MAGIC && header.version == SPU_UDP_VERSION_2;
+}
+
+
+// --------------------------------------------------------------------------
+// FRAME STEERING (LINUX)
+// --------------------------------------------------------------------------
+
+#ifdef __linux__
+#include <linux/filter.h>
+
+/**
+ * @brief Instructions of a frame steering program.
+ */
+static const size_t SPU_UDP_STEERING_LEN = 24;
+
+/**
+ * @brief Classic BPF program returning frame_id % n_targets, so that all the fragments
+ * of a frame go to the same receive thread (SO_ATTACH_REUSEPORT_CBPF, PACKET_FANOUT_CBPF).
+ *
+ * The SPU header starts 'header_offset' bytes into the data the program sees, counted
+ * from the end of the IP header if 'behind_ip' (its length is read from the packet).
+ * frame_id is at offset 0 of a v1 header, 8 of a v2 one (recognised by its magic).
+ * It is little endian, BPF loads are big endian: assemble it byte by byte.
+ */
+inline void spu_udp_steering_program(struct sock_filter (&code)[SPU_UDP_STEERING_LEN], uint32_t header_offset,
+                                     bool behind_ip, uint32_t n_targets) {
+    const uint32_t off = header_offset + offsetof(SpuUdpHeader, frame_id);
+    const uint32_t v2_off = offsetof(SpuUdpHeaderV2, frame_id) - offsetof(SpuUdpHeader, frame_id);
+    const uint16_t load_base = behind_ip ? (BPF_LDX | BPF_B | BPF_MSH)  // X = IP header length
+                                         : (BPF_LDX | BPF_IMM);         // X = 0
+    const struct sock_filter program[] = {
+        BPF_STMT(load_base,                   0),
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_IND, header_offset),          // First word of the SPU header
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   __builtin_bswap32(SPU_UDP_V2_MAGIC), 0, 3),
+        BPF_STMT(BPF_MISC| BPF_TXA,           0),
+        BPF_STMT(BPF_ALU | BPF_ADD | BPF_K,   v2_off),
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),                      // X += v2 frame_id shift
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, off + 3),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   24),
+        BPF_STMT(BPF_ST,                      0),                      // M[0] = byte 3 << 24
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, off + 2),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   16),
+        BPF_STMT(BPF_ST,                      1),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, off + 1),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K,   8),
+        BPF_STMT(BPF_ST,                      2),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, off + 0),
+        BPF_STMT(BPF_LDX | BPF_MEM,           2),
+        BPF_STMT(BPF_ALU | BPF_OR  | BPF_X,   0),
+        BPF_STMT(BPF_LDX | BPF_MEM,           1),
+        BPF_STMT(BPF_ALU | BPF_OR  | BPF_X,   0),
+        BPF_STMT(BPF_LDX | BPF_MEM,           0),
+        BPF_STMT(BPF_ALU | BPF_OR  | BPF_X,   0),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,   n_targets),
+        BPF_STMT(BPF_RET | BPF_A,             0),
+    };
+    static_assert(sizeof(program) / sizeof(program[0]) == SPU_UDP_STEERING_LEN, "steering program length");
+    std::memcpy(code, program, sizeof(program));
+}
+#endif // __linux__
+
 #endif // SPU_UDP_PROTOCOL_H
\ No newline at end of file
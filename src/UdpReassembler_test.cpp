@@ -2,9 +2,17 @@
 #include <vector>
 #include <cassert>
 #include <cstring>
+#include <algorithm>
 #include <iomanip>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <fstream>
 
 #include "UdpReassembler.hpp"
+#include "UdpPacketizer.hpp"
+#include "FixedUdpPacketizer.hpp"
+#include "UdpSink.hpp"
 
 // --------------------------------------------------------------------------
 // TEST UTILS
@@ -124,11 +132,813 @@ void test_interleaved_frames() {
     ASSERT_TRUE(resB.frame_id == 20, "Finished ID is 20");
 }
 
+void test_direct_target() {
+    std::cout << "\n--- TEST: Direct Mode (Target Buffer) ---" << std::endl;
+    UdpReassembler reassembler;
+    std::vector<uint8_t> target(2 * SPU_UDP_MAX_PAYLOAD + 100, 0);
+
+    reassembler.set_target(target.data(), target.size());
+
+    auto p0 = create_packet(400, 0, 3, 0x11);
+    auto p1 = create_packet(400, 1, 3, 0x22);
+    auto p2 = create_packet(400, 2, 3, 0x33);
+    p2.payload.resize(100);
+
+    reassembler.add_fragment(p0.header, p0.payload.data(), p0.payload.size());
+    reassembler.add_fragment(p2.header, p2.payload.data(), p2.payload.size());
+    auto res = reassembler.add_fragment(p1.header, p1.payload.data(), p1.payload.size());
+
+    ASSERT_TRUE(res.complete && res.in_target, "Frame completes in the target buffer");
+    ASSERT_TRUE(res.data.empty(), "No intermediate buffer returned");
+    ASSERT_TRUE(res.target_size == target.size(), "Exact size written into target");
+    ASSERT_TRUE(target[0] == 0x11 && target[SPU_UDP_MAX_PAYLOAD] == 0x22, "Target content (head)");
+    ASSERT_TRUE(target[2 * SPU_UDP_MAX_PAYLOAD + 99] == 0x33, "Target content (tail)");
+
+    // Releasing a partially filled target keeps the frame alive in an internal buffer
+    reassembler.set_target(target.data(), target.size());
+    auto q0 = create_packet(401, 0, 2, 0x44);
+    auto q1 = create_packet(401, 1, 2, 0x55);
+    reassembler.add_fragment(q0.header, q0.payload.data(), q0.payload.size());
+    reassembler.release_target();
+    std::fill(target.begin(), target.end(), 0);
+
+    auto res_q = reassembler.add_fragment(q1.header, q1.payload.data(), q1.payload.size());
+    ASSERT_TRUE(res_q.complete && !res_q.in_target, "Released frame completes internally");
+    ASSERT_TRUE(res_q.data[0] == 0x44 && res_q.data[SPU_UDP_MAX_PAYLOAD] == 0x55, "Migrated content preserved");
+
+    // Arming the target while the expected frame is in flight adopts it (no N+1 detour)
+    auto r0 = create_packet(402, 0, 3, 0x66);
+    auto r1 = create_packet(402, 1, 3, 0x77);
+    auto r2 = create_packet(402, 2, 3, 0x88);
+    r2.payload.resize(100);
+    reassembler.add_fragment(r0.header, r0.payload.data(), r0.payload.size());
+    reassembler.add_fragment(r2.header, r2.payload.data(), r2.payload.size());
+    ASSERT_TRUE(reassembler.get_pending_bytes() > 0, "In-flight frame charged before adoption");
+
+    std::fill(target.begin(), target.end(), 0);
+    reassembler.set_target(target.data(), target.size(), 402);
+    ASSERT_TRUE(reassembler.get_pending_bytes() == 0, "Adopted frame no longer charged");
+
+    auto s0 = create_packet(403, 0, 2, 0x99);
+    auto res_s = reassembler.add_fragment(s0.header, s0.payload.data(), s0.payload.size());
+    ASSERT_TRUE(!res_s.complete && reassembler.get_pending_bytes() > 0, "Newer frame goes to an internal buffer");
+
+    auto res_r = reassembler.add_fragment(r1.header, r1.payload.data(), r1.payload.size());
+    ASSERT_TRUE(res_r.complete && res_r.in_target && res_r.frame_id == 402, "Adopted frame completes in the target");
+    ASSERT_TRUE(res_r.target_size == target.size(), "Adopted frame size");
+    ASSERT_TRUE(target[0] == 0x66 && target[SPU_UDP_MAX_PAYLOAD] == 0x77, "Adopted content (head)");
+    ASSERT_TRUE(target[2 * SPU_UDP_MAX_PAYLOAD + 99] == 0x88, "Adopted content (tail)");
+}
+
+void test_buffer_recycling() {
+    std::cout << "\n--- TEST: Frame Buffer Recycling ---" << std::endl;
+    UdpReassembler reassembler;
+    reassembler.preallocate(4 * SPU_UDP_MAX_PAYLOAD, 2);
+    size_t base_allocs = reassembler.get_pool()->get_allocations();
+
+    bool all_ok = true;
+    for (uint32_t f = 0; f < 50; ++f) {
+        UdpReassembler::Result res = {false, {}, 0, false, 0};
+        for (uint32_t i = 0; i < 4; ++i) {
+            auto p = create_packet(500 + f, i, 4, static_cast<uint8_t>(f));
+            res = reassembler.add_fragment(p.header, p.payload.data(), p.payload.size());
+        }
+        all_ok = all_ok && res.complete && res.data[3 * SPU_UDP_MAX_PAYLOAD] == static_cast<uint8_t>(f);
+        // 'res' goes out of scope: its buffer returns to the pool
+    }
+    ASSERT_TRUE(all_ok, "50 consecutive frames reassembled");
+
+    ASSERT_TRUE(reassembler.get_pool()->get_allocations() == base_allocs, "Steady state performs no allocation");
+    ASSERT_TRUE(reassembler.get_pool()->get_recycled() >= 50, "Buffers were recycled");
+}
+
+void test_scatter_prediction() {
+    std::cout << "\n--- TEST: Scatter Receive (Predicted Slots) ---" << std::endl;
+    UdpReassembler reassembler;
+
+    // First fragment goes through the regular path
+    auto p0 = create_packet(600, 0, 3, 0x10);
+    reassembler.add_fragment(p0.header, p0.payload.data(), p0.payload.size());
+
+    UdpReassembler::Prediction pred[4];
+    reassembler.predict_slots(p0.header, pred, 4);
+    ASSERT_TRUE(pred[0].frame_id == 600 && pred[0].frag_index == 1 && pred[0].slot != nullptr, "Next fragment predicted");
+    ASSERT_TRUE(pred[2].frame_id == 601 && pred[2].frag_index == 0 && pred[2].slot != nullptr, "Next frame opened speculatively");
+
+    // Fragment 1 lands in place, fragment 2 arrives where fragment 1 of the next frame was expected
+    auto p1 = create_packet(600, 1, 3, 0x11);
+    auto p2 = create_packet(600, 2, 3, 0x12);
+    std::memcpy(pred[0].slot, p1.payload.data(), p1.payload.size());
+    std::memcpy(pred[3].slot, p2.payload.data(), p2.payload.size());
+
+    auto res1 = reassembler.commit_fragment(p1.header, pred[0].slot, p1.payload.size());
+    ASSERT_TRUE(!res1.complete, "In-place commit accepted");
+    auto res2 = reassembler.commit_fragment(p2.header, pred[3].slot, p2.payload.size());
+    ASSERT_TRUE(res2.complete, "Mispredicted fragment falls back to a copy");
+    ASSERT_TRUE(res2.data[SPU_UDP_MAX_PAYLOAD] == 0x11 && res2.data[2 * SPU_UDP_MAX_PAYLOAD] == 0x12, "Content is correct");
+
+    // The speculative frame is restarted when the real fragment count differs
+    auto q0 = create_packet(601, 0, 1, 0x20);
+    auto res_q = reassembler.add_fragment(q0.header, q0.payload.data(), q0.payload.size());
+    ASSERT_TRUE(res_q.complete && res_q.data.size() == SPU_UDP_MAX_PAYLOAD, "Speculative frame resized to real header");
+
+    // Restarted mid-batch, a speculative frame keeps its old buffer readable until end_commit()
+    UdpReassembler restart;
+    auto r0 = create_packet(800, 0, 2, 0x40);
+    restart.add_fragment(r0.header, r0.payload.data(), r0.payload.size());
+    restart.predict_slots(r0.header, pred, 3);
+    ASSERT_TRUE(pred[1].frame_id == 801 && pred[2].frame_id == 801 && pred[2].slot != nullptr, "Slots in the speculative frame");
+    auto s0 = create_packet(801, 0, 3, 0x41);
+    auto s1 = create_packet(801, 1, 3, 0x42);
+    auto s2 = create_packet(801, 2, 3, 0x43);
+    std::memcpy(pred[1].slot, s0.payload.data(), s0.payload.size());
+    std::memcpy(pred[2].slot, s1.payload.data(), s1.payload.size());
+    restart.commit_fragment(s0.header, pred[1].slot, s0.payload.size());
+    restart.commit_fragment(s1.header, pred[2].slot, s1.payload.size());
+    restart.end_commit();
+    auto res_s = restart.add_fragment(s2.header, s2.payload.data(), s2.payload.size());
+    ASSERT_TRUE(res_s.complete && res_s.data[0] == 0x41 && res_s.data[SPU_UDP_MAX_PAYLOAD] == 0x42 &&
+                res_s.data[2 * SPU_UDP_MAX_PAYLOAD] == 0x43, "Fragments committed after the restart are intact");
+
+    // Frames with slots in the batch are not evicted before end_commit()
+    const size_t frame_cost = FrameBufferPool::class_size(3 * SPU_UDP_MAX_PAYLOAD);
+    UdpReassembler budget;
+    budget.set_memory_budget(2 * frame_cost);
+    auto a0 = create_packet(700, 0, 3, 0x50);
+    auto b0 = create_packet(701, 0, 3, 0x51);
+    auto c0 = create_packet(702, 0, 3, 0x52);
+    budget.add_fragment(a0.header, a0.payload.data(), a0.payload.size());
+    budget.add_fragment(b0.header, b0.payload.data(), b0.payload.size());
+    budget.predict_slots(a0.header, pred, 2);
+    budget.add_fragment(c0.header, c0.payload.data(), c0.payload.size());
+    FragmentRange ranges[2];
+    ASSERT_TRUE(budget.get_evicted_frames() == 1 && budget.get_missing_fragments(700, ranges, 2) == 1 &&
+                budget.get_missing_fragments(701, ranges, 2) == 0, "Oldest frame kept while its slots are out");
+
+    auto a1 = create_packet(700, 1, 3, 0x53);
+    std::memcpy(pred[0].slot, a1.payload.data(), a1.payload.size());
+    budget.commit_fragment(a1.header, pred[0].slot, a1.payload.size());
+    budget.end_commit();
+    auto d0 = create_packet(703, 0, 3, 0x54);
+    budget.add_fragment(d0.header, d0.payload.data(), d0.payload.size());
+    ASSERT_TRUE(budget.get_evicted_frames() == 2 && budget.get_missing_fragments(700, ranges, 2) == 0,
+                "Evictable again after end_commit()");
+}
+
+void test_frame_window() {
+    std::cout << "\n--- TEST: Frame Window (Wraparound & Eviction) ---" << std::endl;
+    UdpReassembler reassembler(4);
+    ASSERT_TRUE(reassembler.get_window() == 4, "Window size");
+
+    // Frame IDs wrap around 2^32
+    auto a0 = create_packet(0xFFFFFFFEu, 0, 2, 0xA0);
+    auto b0 = create_packet(0x00000001u, 0, 2, 0xB0);
+    reassembler.add_fragment(a0.header, a0.payload.data(), a0.payload.size());
+    reassembler.add_fragment(b0.header, b0.payload.data(), b0.payload.size());
+    ASSERT_TRUE(reassembler.get_pending_count() == 2, "Both frames pending across the wraparound");
+
+    auto a1 = create_packet(0xFFFFFFFEu, 1, 2, 0xA1);
+    auto resA = reassembler.add_fragment(a1.header, a1.payload.data(), a1.payload.size());
+    ASSERT_TRUE(resA.complete && resA.frame_id == 0xFFFFFFFEu, "Frame before the wraparound completes");
+
+    // Frame 5 pushes frame 1 out of the window
+    auto c0 = create_packet(5, 0, 2, 0xC0);
+    reassembler.add_fragment(c0.header, c0.payload.data(), c0.payload.size());
+    ASSERT_TRUE(reassembler.get_pending_count() == 1, "Frame out of the window is evicted");
+
+    auto b1 = create_packet(1, 1, 2, 0xB1);
+    auto resB = reassembler.add_fragment(b1.header, b1.payload.data(), b1.payload.size());
+    ASSERT_TRUE(!resB.complete && reassembler.get_pending_count() == 1, "Late fragment of an evicted frame is dropped");
+
+    auto c1 = create_packet(5, 1, 2, 0xC1);
+    auto resC = reassembler.add_fragment(c1.header, c1.payload.data(), c1.payload.size());
+    ASSERT_TRUE(resC.complete && resC.data[0] == 0xC0 && resC.data[SPU_UDP_MAX_PAYLOAD] == 0xC1, "Newest frame completes");
+}
+
+void test_missing_ranges() {
+    std::cout << "\n--- TEST: Fragment Bitmap (Missing Ranges) ---" << std::endl;
+
+    // Large bitmap (spills out of the inline words), gaps across word boundaries
+    FragmentBitmap bitmap;
+    bitmap.reset(2000);
+    for (size_t i = 0; i < 2000; ++i)
+        if (i < 60 || (i >= 130 && i < 1999)) bitmap.set(i);
+    ASSERT_TRUE(!bitmap.set(5) && bitmap.test(5) && !bitmap.test(60), "Set/test single bits");
+    ASSERT_TRUE(bitmap.count() == 60 + 1869 && !bitmap.all(), "Popcount");
+
+    FragmentRange ranges[4];
+    size_t n = bitmap.missing_ranges(ranges, 4);
+    ASSERT_TRUE(n == 2 && ranges[0].first == 60 && ranges[0].count == 70 &&
+                ranges[1].first == 1999 && ranges[1].count == 1, "Missing ranges listed in order");
+
+    bitmap.reset(3);
+    ASSERT_TRUE(bitmap.count() == 0 && bitmap.missing_ranges(ranges, 4) == 1 && ranges[0].count == 3, "Reset clears the reused bitmap");
+
+    // Query through the reassembler
+    UdpReassembler reassembler;
+    for (uint32_t i : {0u, 1u, 4u, 6u}) {
+        auto p = create_packet(700, i, 8, 0x70);
+        reassembler.add_fragment(p.header, p.payload.data(), p.payload.size());
+    }
+    n = reassembler.get_missing_fragments(700, ranges, 4);
+    ASSERT_TRUE(n == 3 && ranges[0].first == 2 && ranges[0].count == 2 && ranges[1].first == 5 &&
+                ranges[2].first == 7 && ranges[2].count == 1, "Reassembler reports missing fragments");
+    ASSERT_TRUE(reassembler.get_missing_fragments(701, ranges, 4) == 0, "Unknown frame has no missing ranges");
+}
+
+void test_frame_timeout() {
+    std::cout << "\n--- TEST: Frame Timeout (Timer Wheel) ---" << std::endl;
+    UdpReassembler reassembler;
+    reassembler.set_frame_timeout(100);
+
+    auto a0 = create_packet(800, 0, 2, 0x80);
+    auto b0 = create_packet(801, 0, 2, 0x81);
+    reassembler.add_fragment(a0.header, a0.payload.data(), a0.payload.size());
+    reassembler.add_fragment(b0.header, b0.payload.data(), b0.payload.size());
+
+    // Frame 801 keeps receiving, frame 800 goes stale
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    reassembler.add_fragment(b0.header, b0.payload.data(), b0.payload.size()); // Duplicate: refreshes the frame
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    reassembler.expire_frames();
+    ASSERT_TRUE(reassembler.get_pending_count() == 1 && reassembler.get_expired_frames() == 1, "Stale frame expired");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(120));
+    reassembler.expire_frames();
+    ASSERT_TRUE(reassembler.get_pending_count() == 0 && reassembler.get_expired_frames() == 2, "Idle frame expired without traffic");
+
+    // The late fragment of an expired frame starts it over
+    auto a1 = create_packet(800, 1, 2, 0x80);
+    auto res = reassembler.add_fragment(a1.header, a1.payload.data(), a1.payload.size());
+    ASSERT_TRUE(!res.complete && reassembler.get_pending_count() == 1, "Expired frame is not completed");
+}
+
+void test_batch_add() {
+    std::cout << "\n--- TEST: Batch Add (add_fragments) ---" << std::endl;
+    UdpReassembler reassembler;
+
+    // Two whole frames, the start of a third and a duplicate in a single batch
+    std::vector<FakePacket> packets;
+    for (uint32_t f = 900; f < 902; ++f)
+        for (uint32_t i = 0; i < 3; ++i) packets.push_back(create_packet(f, i, 3, static_cast<uint8_t>(f + i)));
+    packets.push_back(create_packet(902, 0, 2, 0x33));
+    packets.push_back(create_packet(902, 0, 2, 0x33));
+
+    std::vector<UdpReassembler::Fragment> batch;
+    for (auto& p : packets) batch.push_back({spu_udp_info(p.header), p.payload.data(), p.payload.size()});
+
+    std::vector<UdpReassembler::Result> completed;
+    size_t n = reassembler.add_fragments(batch.data(), batch.size(), completed);
+    ASSERT_TRUE(n == 2 && completed.size() == 2, "Both complete frames returned");
+    ASSERT_TRUE(completed[0].frame_id == 900 && completed[1].frame_id == 901, "Completion order kept");
+    ASSERT_TRUE(completed[1].data[0] == static_cast<uint8_t>(901) &&
+                completed[1].data[2 * SPU_UDP_MAX_PAYLOAD] == static_cast<uint8_t>(903), "Content is correct");
+    ASSERT_TRUE(reassembler.get_pending_count() == 1, "Partial frame stays pending");
+
+    // The next batch finishes it
+    auto last = create_packet(902, 1, 2, 0x34);
+    UdpReassembler::Fragment tail = {spu_udp_info(last.header), last.payload.data(), last.payload.size()};
+    completed.clear();
+    n = reassembler.add_fragments(&tail, 1, completed);
+    ASSERT_TRUE(n == 1 && completed[0].frame_id == 902 && completed[0].data[SPU_UDP_MAX_PAYLOAD] == 0x34, "Frame spanning batches completes");
+}
+
+void test_memory_budget() {
+    std::cout << "\n--- TEST: Memory Budget (Eviction Policies) ---" << std::endl;
+    const size_t frame_cost = FrameBufferPool::class_size(4 * SPU_UDP_MAX_PAYLOAD);
+
+    // Room for two 4-fragment frames
+    UdpReassembler oldest;
+    oldest.set_memory_budget(2 * frame_cost, UdpReassembler::EvictionPolicy::OLDEST_FIRST);
+
+    auto huge = create_packet(1000, 0, 1000000, 0x00);
+    oldest.add_fragment(huge.header, huge.payload.data(), huge.payload.size());
+    ASSERT_TRUE(oldest.get_rejected_frames() == 1 && oldest.get_pending_bytes() == 0, "Frame larger than the budget rejected");
+
+    for (uint32_t f = 1001; f <= 1003; ++f) {
+        auto p0 = create_packet(f, 0, 4, 0x10);
+        oldest.add_fragment(p0.header, p0.payload.data(), p0.payload.size());
+        if (f == 1001) {
+            auto p1 = create_packet(f, 1, 4, 0x11);
+            oldest.add_fragment(p1.header, p1.payload.data(), p1.payload.size());
+        }
+    }
+    ASSERT_TRUE(oldest.get_evicted_frames() == 1 && oldest.get_pending_bytes() == 2 * frame_cost, "Budget holds");
+    FragmentRange ranges[2];
+    ASSERT_TRUE(oldest.get_missing_fragments(1001, ranges, 2) == 0 && oldest.get_missing_fragments(1002, ranges, 2) == 1,
+                "Oldest frame evicted");
+
+    // Same traffic, but the frame with the most fragments survives
+    UdpReassembler least;
+    least.set_memory_budget(2 * frame_cost, UdpReassembler::EvictionPolicy::LEAST_COMPLETE_FIRST);
+    for (uint32_t f = 1001; f <= 1003; ++f) {
+        auto p0 = create_packet(f, 0, 4, 0x10);
+        least.add_fragment(p0.header, p0.payload.data(), p0.payload.size());
+        if (f == 1001) {
+            auto p1 = create_packet(f, 1, 4, 0x11);
+            least.add_fragment(p1.header, p1.payload.data(), p1.payload.size());
+        }
+    }
+    ASSERT_TRUE(least.get_evicted_frames() == 1 && least.get_missing_fragments(1001, ranges, 2) == 1 &&
+                least.get_missing_fragments(1002, ranges, 2) == 0, "Least complete frame evicted");
+
+    // Completed frames give their bytes back
+    for (uint32_t i = 2; i < 4; ++i) {
+        auto p = create_packet(1001, i, 4, 0x12);
+        least.add_fragment(p.header, p.payload.data(), p.payload.size());
+    }
+    ASSERT_TRUE(least.get_pending_bytes() == frame_cost, "Completion releases its budget");
+}
+
+void test_lazy_chunks() {
+    std::cout << "\n--- TEST: Lazy Chunk Commit (Large Frames) ---" << std::endl;
+    UdpReassembler reassembler;
+    reassembler.set_lazy_threshold(1 << 20);
+
+    // 3000 fragments = 4.2 MB announced, 3 chunks of 2 MB
+    const uint32_t total = 3000;
+    auto first = create_packet(1100, 0, total, 0x01);
+    reassembler.add_fragment(first.header, first.payload.data(), first.payload.size());
+    const size_t bitmap = FragmentBitmap::heap_bytes(total);
+    ASSERT_TRUE(reassembler.get_pending_bytes() == UdpReassembler::LAZY_CHUNK_SIZE + bitmap, "Only the first chunk is committed");
+
+    // A fragment straddling the first chunk boundary commits the second one
+    uint32_t straddle = static_cast<uint32_t>(UdpReassembler::LAZY_CHUNK_SIZE / SPU_UDP_MAX_PAYLOAD);
+    auto mid = create_packet(1100, straddle, total, 0x02);
+    reassembler.add_fragment(mid.header, mid.payload.data(), mid.payload.size());
+    ASSERT_TRUE(reassembler.get_pending_bytes() == 2 * UdpReassembler::LAZY_CHUNK_SIZE + bitmap, "Straddling fragment commits the next chunk");
+
+    UdpReassembler::Result res = {false, {}, 0, false, 0};
+    for (uint32_t i = 1; i < total; ++i) {
+        if (i == straddle) continue;
+        auto p = create_packet(1100, i, total, static_cast<uint8_t>(i));
+        res = reassembler.add_fragment(p.header, p.payload.data(), i + 1 == total ? 100 : p.payload.size());
+    }
+    ASSERT_TRUE(res.complete && res.data.is_mapped(), "Large frame delivered as one mapping");
+    ASSERT_TRUE(res.data.size() == (total - 1) * SPU_UDP_MAX_PAYLOAD + 100, "Exact size detected");
+    ASSERT_TRUE(res.data[0] == 0x01 && res.data[static_cast<size_t>(straddle) * SPU_UDP_MAX_PAYLOAD] == 0x02 &&
+                res.data[static_cast<size_t>(2999) * SPU_UDP_MAX_PAYLOAD] == static_cast<uint8_t>(2999), "Content is correct");
+    ASSERT_TRUE(reassembler.get_pending_bytes() == 0, "Completion releases its chunks");
+
+    // Frames that lose most fragments only hold what they received
+    for (uint32_t f = 1101; f < 1105; ++f) {
+        auto p = create_packet(f, 5, total, 0x05);
+        reassembler.add_fragment(p.header, p.payload.data(), p.payload.size());
+    }
+    ASSERT_TRUE(reassembler.get_pending_bytes() == 4 * (UdpReassembler::LAZY_CHUNK_SIZE + bitmap), "Peak memory follows received data");
+}
+
+// v2 datagram with an arbitrary payload placement
+std::vector<uint8_t> create_v2_datagram(uint32_t frame_id, uint32_t index, uint32_t total, uint64_t frame_size,
+                                        uint64_t offset, size_t payload_len, uint8_t fill_val) {
+    SpuUdpHeaderV2 h;
+    h.magic = SPU_UDP_V2_MAGIC;
+    h.version = SPU_UDP_VERSION_2;
+    h.flags = 0x80; // Unknown flag: must be ignored
+    h.header_size = static_cast<uint16_t>(SPU_UDP_V2_HEADER_SIZE);
+    h.frame_id = frame_id;
+    h.frag_index = index;
+    h.total_frags = total;
+    h.frame_size = frame_size;
+    h.offset = offset;
+    std::vector<uint8_t> datagram(sizeof(h) + payload_len, fill_val);
+    std::memcpy(datagram.data(), &h, sizeof(h));
+    return datagram;
+}
+
+void test_protocol_v2() {
+    std::cout << "\n--- TEST: Protocol v2 Header ---" << std::endl;
+    UdpReassembler reassembler;
+
+    // The packetizer's v2 datagrams carry the exact size and byte offsets
+    std::vector<uint8_t> frame(3000);
+    for (size_t i = 0; i < frame.size(); ++i) frame[i] = static_cast<uint8_t>(i * 7);
+    UdpPacketizer packetizer;
+    packetizer.set_protocol_version(SPU_UDP_VERSION_2);
+    size_t count = packetizer.prepare_frame(frame.data(), frame.size(), 1200);
+    std::vector<std::vector<uint8_t>> datagrams;
+    for (size_t i = 0; i < count; ++i) {
+        const auto& p = packetizer.get_packets()[i];
+        const uint8_t* h = static_cast<const uint8_t*>(p.iov[0].iov_base);
+        const uint8_t* d = static_cast<const uint8_t*>(p.iov[1].iov_base);
+        std::vector<uint8_t> datagram(h, h + p.iov[0].iov_len);
+        datagram.insert(datagram.end(), d, d + p.iov[1].iov_len);
+        datagrams.push_back(datagram);
+    }
+    SpuFragmentInfo info;
+    ASSERT_TRUE(count == 3 && spu_udp_parse(datagrams[2].data(), datagrams[2].size(), info) &&
+                info.version == SPU_UDP_VERSION_2 && info.header_size == SPU_UDP_V2_HEADER_SIZE &&
+                info.frame_size == 3000 && info.offset == 2 * SPU_UDP_MAX_PAYLOAD, "v2 header parsed");
+
+    // Last fragment first: the buffer is already exact, nothing to trim
+    UdpReassembler::Result res = {false, {}, 0, false, 0};
+    for (int i = 2; i >= 0; --i) {
+        spu_udp_parse(datagrams[i].data(), datagrams[i].size(), info);
+        res = reassembler.add_fragment(info, datagrams[i].data() + info.header_size,
+                                       datagrams[i].size() - info.header_size);
+        if (i == 2) {
+            ASSERT_TRUE(reassembler.get_pending_bytes() == FrameBufferPool::class_size(3000), "Exact-size allocation");
+        }
+    }
+    ASSERT_TRUE(res.complete && res.data.size() == 3000 && std::memcmp(res.data.data(), frame.data(), 3000) == 0,
+                "v2 frame reassembled");
+
+    // v1 still parses, and both versions complete side by side
+    auto v1 = create_packet(1201, 0, 1, 0x11);
+    std::vector<uint8_t> v1_datagram(sizeof(v1.header) + 10, 0x11);
+    std::memcpy(v1_datagram.data(), &v1.header, sizeof(v1.header));
+    ASSERT_TRUE(spu_udp_parse(v1_datagram.data(), v1_datagram.size(), info) && info.version == SPU_UDP_VERSION_1 &&
+                info.header_size == sizeof(SpuUdpHeader) && !info.has_frame_size(), "v1 header parsed");
+
+    // Fragments of different sizes land at their offsets
+    auto a = create_v2_datagram(1202, 0, 2, 10, 0, 4, 0xAA);
+    auto b = create_v2_datagram(1202, 1, 2, 10, 4, 6, 0xBB);
+    auto bad = create_v2_datagram(1202, 1, 2, 10, 8, 6, 0xCC);
+    spu_udp_parse(a.data(), a.size(), info);
+    reassembler.add_fragment(info, a.data() + info.header_size, a.size() - info.header_size);
+    res = reassembler.add_fragment(v1.header, v1_datagram.data() + sizeof(SpuUdpHeader), 10);
+    ASSERT_TRUE(res.complete && res.data.size() == 10, "v1 frame completes next to a v2 one");
+    spu_udp_parse(bad.data(), bad.size(), info);
+    res = reassembler.add_fragment(info, bad.data() + info.header_size, bad.size() - info.header_size);
+    ASSERT_TRUE(!res.complete, "Payload past the frame size dropped");
+    spu_udp_parse(b.data(), b.size(), info);
+    res = reassembler.add_fragment(info, b.data() + info.header_size, b.size() - info.header_size);
+    ASSERT_TRUE(res.complete && res.data.size() == 10 && res.data[3] == 0xAA && res.data[4] == 0xBB &&
+                res.data[9] == 0xBB, "Variable-size fragments placed by offset");
+
+    // Scatter prediction: the last slot of an exact-size frame is only what is left
+    spu_udp_parse(datagrams[0].data(), datagrams[0].size(), info);
+    info.frame_id = 1203;
+    reassembler.add_fragment(info, datagrams[0].data() + info.header_size, SPU_UDP_MAX_PAYLOAD);
+    UdpReassembler::Prediction pred[2];
+    reassembler.predict_slots(info, pred, 2);
+    ASSERT_TRUE(pred[0].slot != nullptr && pred[0].len == SPU_UDP_MAX_PAYLOAD &&
+                pred[1].slot != nullptr && pred[1].len == 200, "Predicted room follows the frame size");
+
+    // Hostile headers: more fragments than bytes (a 512 MB bitmap per frame), index past the count
+    UdpReassembler hostile;
+    auto forged = create_v2_datagram(1300, 0, 0xFFFFFFF0u, 1, 0, 1, 0xEE);
+    auto past_end = create_v2_datagram(1301, 2, 2, 10, 0, 4, 0xEE);
+    spu_udp_parse(forged.data(), forged.size(), info);
+    res = hostile.add_fragment(info, forged.data() + info.header_size, forged.size() - info.header_size);
+    ASSERT_TRUE(!res.complete && hostile.get_pending_bytes() == 0, "More fragments than bytes dropped");
+    spu_udp_parse(past_end.data(), past_end.size(), info);
+    res = hostile.add_fragment(info, past_end.data() + info.header_size, past_end.size() - info.header_size);
+    ASSERT_TRUE(!res.complete && hostile.get_pending_bytes() == 0, "Fragment index past the count dropped");
+
+    // A bitmap too large to live inline is charged to the memory budget
+    const uint32_t many = 4 * FragmentBitmap::INLINE_BITS;
+    auto tiny = create_v2_datagram(1302, 0, many, many, 0, 1, 0x5A);
+    spu_udp_parse(tiny.data(), tiny.size(), info);
+    hostile.add_fragment(info, tiny.data() + info.header_size, tiny.size() - info.header_size);
+    ASSERT_TRUE(hostile.get_pending_bytes() == FrameBufferPool::class_size(many) + many / 8,
+                "Fragment bitmap charged");
+}
+
+void test_payload_size() {
+    std::cout << "\n--- TEST: Runtime Payload Size ---" << std::endl;
+    UdpReassembler reassembler;
+    UdpPacketizer packetizer;
+
+    // Jumbo payloads: a 100 KB frame in 12 fragments instead of 74, sent as v2
+    std::vector<uint8_t> frame(100000);
+    for (size_t i = 0; i < frame.size(); ++i) frame[i] = static_cast<uint8_t>(i * 13);
+    packetizer.set_payload_size(8900);
+    size_t count = packetizer.prepare_frame(frame.data(), frame.size(), 1300);
+    ASSERT_TRUE(count == 12 && packetizer.get_protocol_version() == SPU_UDP_VERSION_2, "Non-default payload size uses v2");
+
+    UdpReassembler::Result res = {false, {}, 0, false, 0};
+    for (size_t i = 0; i < count; ++i) {
+        const auto& p = packetizer.get_packets()[count - 1 - i];
+        std::vector<uint8_t> datagram(static_cast<const uint8_t*>(p.iov[0].iov_base),
+                                      static_cast<const uint8_t*>(p.iov[0].iov_base) + p.iov[0].iov_len);
+        datagram.insert(datagram.end(), static_cast<const uint8_t*>(p.iov[1].iov_base),
+                        static_cast<const uint8_t*>(p.iov[1].iov_base) + p.iov[1].iov_len);
+        SpuFragmentInfo info;
+        if (!spu_udp_parse(datagram.data(), datagram.size(), info)) break;
+        res = reassembler.add_fragment(info, datagram.data() + info.header_size, datagram.size() - info.header_size);
+    }
+    ASSERT_TRUE(res.complete && res.data.size() == frame.size() &&
+                std::memcmp(res.data.data(), frame.data(), frame.size()) == 0, "Jumbo fragments reassembled");
+
+    // Back to the v1 payload size: v1 headers again
+    packetizer.set_payload_size(SPU_UDP_MAX_PAYLOAD);
+    packetizer.prepare_frame(frame.data(), frame.size(), 1301);
+    ASSERT_TRUE(packetizer.get_protocol_version() == SPU_UDP_VERSION_1 &&
+                packetizer.get_packets()[0].iov[0].iov_len == sizeof(SpuUdpHeader), "Default payload size keeps v1");
+
+    bool thrown = false;
+    try {
+        packetizer.set_payload_size(SPU_UDP_MAX_DATAGRAM);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT_TRUE(thrown, "Payload larger than a datagram refused");
+}
+
+/**
+ * @brief Same datagrams (header bytes, payload slices) from both packetizers.
+ */
+template <typename Fixed>
+bool same_packets(const UdpPacketizer& dynamic, const Fixed& fixed) {
+    if (dynamic.get_count() != fixed.get_count()) return false;
+    for (size_t i = 0; i < dynamic.get_count(); ++i) {
+        const auto& a = dynamic.get_packets()[i];
+        const auto& b = fixed.get_packets()[i];
+        if (a.iov[0].iov_len != b.iov[0].iov_len || a.iov[1].iov_len != b.iov[1].iov_len ||
+            a.iov[1].iov_base != b.iov[1].iov_base ||
+            std::memcmp(a.iov[0].iov_base, b.iov[0].iov_base, a.iov[0].iov_len) != 0)
+            return false;
+    }
+    return true;
+}
+
+SpuFragmentInfo packet_info(const UdpPacketizer::Packet& p) {
+    SpuFragmentInfo info = {};
+    spu_udp_parse(p.iov[0].iov_base, p.iov[0].iov_len, info);
+    return info;
+}
+
+void test_fixed_geometry() {
+    std::cout << "\n--- TEST: Compile-Time Geometry ---" << std::endl;
+    typedef FixedUdpPacketizer<8900, 100000> Packetizer;
+    static_assert(Packetizer::FRAGMENTS == 12 && Packetizer::TAIL_SIZE == 2100, "Constant geometry");
+
+    std::vector<uint8_t> frame(100000);
+    for (size_t i = 0; i < frame.size(); ++i) frame[i] = static_cast<uint8_t>(i * 7);
+
+    // Same wire format as the runtime packetizer, v1 and v2
+    UdpPacketizer dynamic;
+    Packetizer fixed;
+    dynamic.set_payload_size(8900);
+    dynamic.prepare_frame(frame.data(), frame.size(), 1400);
+    fixed.prepare_frame(frame.data(), frame.size(), 1400);
+    ASSERT_TRUE(same_packets(dynamic, fixed), "Fixed frame size: same datagrams");
+
+    FixedUdpPacketizer<SPU_UDP_MAX_PAYLOAD, 100000> fixed_v1;
+    dynamic.set_payload_size(SPU_UDP_MAX_PAYLOAD);
+    dynamic.prepare_frame(frame.data(), frame.size(), 1401);
+    fixed_v1.prepare_frame(frame.data(), frame.size(), 1401);
+    ASSERT_TRUE(fixed_v1.get_protocol_version() == SPU_UDP_VERSION_1 && same_packets(dynamic, fixed_v1),
+                "v1 payload size: same v1 datagrams");
+    dynamic.set_protocol_version(SPU_UDP_VERSION_2);
+    fixed_v1.set_protocol_version(SPU_UDP_VERSION_2);
+    dynamic.prepare_frame(frame.data(), frame.size(), 1402);
+    fixed_v1.prepare_frame(frame.data(), frame.size(), 1402);
+    ASSERT_TRUE(same_packets(dynamic, fixed_v1), "v1 payload size, v2 requested: same datagrams");
+
+    FixedUdpPacketizer<1000> any_size;
+    dynamic.set_payload_size(1000);
+    dynamic.prepare_frame(frame.data(), 12345, 1403);
+    any_size.prepare_frame(frame.data(), 12345, 1403);
+    ASSERT_TRUE(same_packets(dynamic, any_size), "Fixed payload size only: same datagrams");
+
+    // The specialised reassembler takes the runtime packetizer's datagrams
+    FixedUdpReassembler<8900, 100000> reassembler;
+    dynamic.set_payload_size(8900);
+    size_t count = dynamic.prepare_frame(frame.data(), frame.size(), 1404);
+    UdpReassembler::Result res = {false, {}, 0, false, 0};
+    for (size_t i = 0; i < count; ++i) {
+        const auto& p = dynamic.get_packets()[(i * 5) % count]; // 5 and 12 coprime: every fragment once
+        res = reassembler.add_fragment(packet_info(p), p.iov[1].iov_base, p.iov[1].iov_len);
+    }
+    ASSERT_TRUE(res.complete && res.data.size() == frame.size() &&
+                std::memcmp(res.data.data(), frame.data(), frame.size()) == 0, "Fixed geometry reassembled");
+
+    // Another geometry is dropped
+    dynamic.set_payload_size(9000);
+    dynamic.prepare_frame(frame.data(), frame.size(), 1405);
+    const auto& other = dynamic.get_packets()[0];
+    res = reassembler.add_fragment(packet_info(other), other.iov[1].iov_base, other.iov[1].iov_len);
+    ASSERT_TRUE(!res.complete && reassembler.get_pending_count() == 0, "Other payload size dropped");
+    dynamic.set_payload_size(8900);
+    dynamic.prepare_frame(frame.data(), 50000, 1406);
+    const auto& shorter = dynamic.get_packets()[0];
+    res = reassembler.add_fragment(packet_info(shorter), shorter.iov[1].iov_base, shorter.iov[1].iov_len);
+    ASSERT_TRUE(!res.complete && reassembler.get_pending_count() == 0, "Other frame size dropped");
+
+    bool thrown = false;
+    try {
+        fixed.prepare_frame(frame.data(), 50000, 1407);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT_TRUE(thrown, "Frame of another size refused by the fixed packetizer");
+}
+
+/**
+ * @brief Feed the prepared packets in 'order' (indices, all packets if empty) except 'lost'.
+ */
+template <typename Packetizer, typename Reassembler>
+typename Reassembler::Result feed(const Packetizer& packetizer, Reassembler& reassembler,
+                                  const std::vector<size_t>& lost, std::vector<size_t> order = {}) {
+    if (order.empty())
+        for (size_t i = 0; i < packetizer.get_count(); ++i) order.push_back(i);
+    typename Reassembler::Result res = {false, {}, 0, false, 0};
+    for (size_t i : order) {
+        if (std::find(lost.begin(), lost.end(), i) != lost.end()) continue;
+        const auto& p = packetizer.get_packets()[i];
+        typename Reassembler::Result r = reassembler.add_fragment(packet_info(p), p.iov[1].iov_base, p.iov[1].iov_len);
+        if (r.complete) res = std::move(r);
+    }
+    return res;
+}
+
+void test_fec() {
+    std::cout << "\n--- TEST: FEC Parity Fragments ---" << std::endl;
+    std::vector<uint8_t> frame(100000);
+    for (size_t i = 0; i < frame.size(); ++i) frame[i] = static_cast<uint8_t>(i * 31 + (i >> 9));
+
+    // One XOR parity per 4 fragments: 12 data + 3 parity packets, parity after each block
+    UdpPacketizer packetizer;
+    packetizer.set_payload_size(8900);
+    packetizer.set_fec(4, 1);
+    size_t count = packetizer.prepare_frame(frame.data(), frame.size(), 1500);
+    ASSERT_TRUE(count == 15 && packet_info(packetizer.get_packets()[4]).is_parity() &&
+                packet_info(packetizer.get_packets()[14]).is_parity() &&
+                packetizer.get_packets()[14].iov[1].iov_len == 8900, "Parity packets follow each block");
+
+    // Receivers without FEC see an offset beyond the frame: dropped
+    SpuFragmentInfo parity_info = packet_info(packetizer.get_packets()[4]);
+    ASSERT_TRUE(parity_info.offset > parity_info.frame_size, "Parity offset out of the frame");
+
+    UdpReassembler reassembler;
+    UdpReassembler::Result res = feed(packetizer, reassembler, {1, 7, 13}); // One loss per block, the tail included
+    ASSERT_TRUE(res.complete && res.data.size() == frame.size() &&
+                std::memcmp(res.data.data(), frame.data(), frame.size()) == 0 &&
+                reassembler.get_recovered_fragments() == 3, "XOR parity rebuilds one loss per block");
+
+    // Two losses in a block with one parity: not recoverable
+    packetizer.prepare_frame(frame.data(), frame.size(), 1501);
+    res = feed(packetizer, reassembler, {0, 1});
+    ASSERT_TRUE(!res.complete && reassembler.get_pending_count() == 1, "Too many losses for the parity");
+
+    // Reed-Solomon, 3 parity per 5 fragments: up to 3 losses per block, parity before data
+    packetizer.set_fec(5, 3);
+    count = packetizer.prepare_frame(frame.data(), frame.size(), 1502);
+    ASSERT_TRUE(count == 12 + 3 * 3, "3 blocks of 5 + 3, the last one shorter");
+    std::vector<size_t> order;
+    for (size_t i = count; i-- > 0;) order.push_back(i);
+    res = feed(packetizer, reassembler, {0, 2, 4, 9, 10, 19}, order);
+    ASSERT_TRUE(res.complete && res.data.size() == frame.size() &&
+                std::memcmp(res.data.data(), frame.data(), frame.size()) == 0 &&
+                reassembler.get_recovered_fragments() == 3 + 8, "Reed-Solomon rebuilds several losses");
+
+    // Parity of a completed frame does not reopen it
+    size_t pending = reassembler.get_pending_count();
+    const auto& late = packetizer.get_packets()[5];
+    res = reassembler.add_fragment(packet_info(late), late.iov[1].iov_base, late.iov[1].iov_len);
+    ASSERT_TRUE(!res.complete && reassembler.get_pending_count() == pending, "Late parity dropped");
+
+    // Malformed parity (row beyond the parity count) is dropped
+    SpuFragmentInfo bad = packet_info(packetizer.get_packets()[5]);
+    bad.frame_id = 1503;
+    bad.offset = spu_udp_parity_offset(5, 3, 3);
+    res = reassembler.add_fragment(bad, late.iov[1].iov_base, late.iov[1].iov_len);
+    ASSERT_TRUE(reassembler.get_pending_count() == pending, "Malformed parity dropped");
+
+    // Compile-time geometry: same parity, same recovery
+    FixedUdpPacketizer<8900, 100000> fixed;
+    fixed.set_fec(5, 3);
+    fixed.prepare_frame(frame.data(), frame.size(), 1504);
+    packetizer.prepare_frame(frame.data(), frame.size(), 1504);
+    bool same = fixed.get_count() == packetizer.get_count();
+    for (size_t i = 0; same && i < fixed.get_count(); ++i) {
+        const auto& a = fixed.get_packets()[i];
+        const auto& b = packetizer.get_packets()[i];
+        same = a.iov[0].iov_len == b.iov[0].iov_len && a.iov[1].iov_len == b.iov[1].iov_len &&
+               std::memcmp(a.iov[0].iov_base, b.iov[0].iov_base, a.iov[0].iov_len) == 0 &&
+               std::memcmp(a.iov[1].iov_base, b.iov[1].iov_base, a.iov[1].iov_len) == 0;
+    }
+    ASSERT_TRUE(same, "Fixed packetizer: same data and parity datagrams");
+    FixedUdpReassembler<8900, 100000> fixed_reassembler;
+    res = feed(fixed, fixed_reassembler, {0, 9, 17});
+    ASSERT_TRUE(res.complete && std::memcmp(res.data.data(), frame.data(), frame.size()) == 0 &&
+                fixed_reassembler.get_recovered_fragments() == 3, "Fixed reassembler rebuilds losses");
+
+    // Scatter prediction leaves the parity slots out
+    packetizer.set_fec(4, 1);
+    packetizer.prepare_frame(frame.data(), frame.size(), 1505);
+    UdpReassembler scatter;
+    feed(packetizer, scatter, {}, {0, 1, 2, 3, 4});
+    UdpReassembler::Prediction pred[3];
+    scatter.predict_slots(packet_info(packetizer.get_packets()[3]), pred, 3);
+    ASSERT_TRUE(pred[0].slot == nullptr && pred[1].frag_index == 4 && pred[1].slot != nullptr &&
+                pred[2].frag_index == 5, "Parity slot skipped by the prediction");
+
+    bool thrown = false;
+    try {
+        packetizer.set_fec(250, 10);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    ASSERT_TRUE(thrown, "Block beyond GF(2^8) refused");
+}
+
+void test_nack() {
+    std::cout << "\n--- TEST: NACK Reporting ---" << std::endl;
+    UdpReassembler reassembler;
+    reassembler.set_nack(20, 50);
+
+    auto p0 = create_packet(1600, 0, 4, 0x10);
+    auto p1 = create_packet(1600, 1, 4, 0x11);
+    auto p2 = create_packet(1600, 2, 4, 0x12);
+    auto p3 = create_packet(1600, 3, 4, 0x13);
+    reassembler.add_fragment(p0.header, p0.payload.data(), p0.payload.size());
+    reassembler.add_fragment(p2.header, p2.payload.data(), p2.payload.size());
+
+    uint32_t frame_id = 0;
+    FragmentRange ranges[4];
+    ASSERT_TRUE(reassembler.poll_nack(frame_id, ranges, 4) == 0, "No NACK within the reorder delay");
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    ASSERT_TRUE(reassembler.poll_nack(frame_id, ranges, 4) == 1 && frame_id == 1600 && ranges[0].first == 1 &&
+                ranges[0].count == 1, "Quiet frame: gap below the highest fragment reported");
+    ASSERT_TRUE(reassembler.poll_nack(frame_id, ranges, 4) == 0, "Not reported again before the retry interval");
+
+    // Once the sender moved on, the tail is missing too
+    auto q0 = create_packet(1601, 0, 2, 0x20);
+    reassembler.add_fragment(q0.header, q0.payload.data(), q0.payload.size());
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    size_t count = 0;
+    bool tail = false;
+    while ((count = reassembler.poll_nack(frame_id, ranges, 4)) > 0)
+        if (frame_id == 1600) tail = count == 2 && ranges[1].first == 3 && ranges[1].count == 1;
+    ASSERT_TRUE(tail, "Tail reported after a newer frame");
+
+    // Retransmitted fragments complete it; a duplicate retransmission does not reopen it
+    reassembler.add_fragment(p1.header, p1.payload.data(), p1.payload.size());
+    auto res = reassembler.add_fragment(p3.header, p3.payload.data(), p3.payload.size());
+    ASSERT_TRUE(res.complete, "Frame completed by the retransmission");
+    res = reassembler.add_fragment(p3.header, p3.payload.data(), p3.payload.size());
+    ASSERT_TRUE(!res.complete && reassembler.get_pending_count() == 1, "Late duplicate of a delivered frame dropped");
+
+    // NACK wire format
+    SpuNackHeader header = {SPU_UDP_NACK_MAGIC, SPU_UDP_VERSION_2, 0, 2, 1600};
+    std::vector<uint8_t> datagram(sizeof(header) + 2 * sizeof(SpuNackRange));
+    std::memcpy(datagram.data(), &header, sizeof(header));
+    SpuNackHeader parsed;
+    ASSERT_TRUE(spu_udp_parse_nack(datagram.data(), datagram.size(), parsed) && parsed.frame_id == 1600 &&
+                !spu_udp_parse_nack(datagram.data(), datagram.size() - 1, parsed), "NACK datagram checked");
+}
+
+void test_zerocopy_enobufs() {
+    std::cout << "\n--- TEST: Zero-Copy Sends Out of optmem (ENOBUFS) ---" << std::endl;
+    // Room for about one pending notification: the sends hit ENOBUFS until it is read (needs root)
+    const char* optmem_path = "/proc/sys/net/core/optmem_max";
+    std::string optmem;
+    std::ifstream(optmem_path) >> optmem;
+    std::ofstream limit(optmem_path);
+    if (optmem.empty() || !(limit << 1024 << std::flush)) {
+        std::cout << "[SKIP] optmem_max not writable" << std::endl;
+        return;
+    }
+
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9961);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(rx, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+
+    UdpSink sink("127.0.0.1", 9961);
+    sink.set_zerocopy(true);
+    std::vector<uint8_t> frame(4 << 20, 0x5A);
+    std::atomic<bool> done(false);
+    std::thread sender([&] {
+        for (int i = 0; i < 3; ++i) sink.send_frame(frame.data(), frame.size());
+        sink.wait_all_released();
+        done = true;
+    });
+    for (int i = 0; i < 100 && !done; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::ofstream(optmem_path) << optmem;
+    close(rx);
+    if (!done) sender.detach();
+    ASSERT_TRUE(done, "send_frame() returns, every buffer released");
+    sender.join();
+    ASSERT_TRUE(sink.is_released(frame.data()), "Frame released");
+}
+
 int main() {
     test_nominal_ordered();
     test_out_of_order();
     test_duplicate_packets();
     test_interleaved_frames();
+    test_direct_target();
+    test_buffer_recycling();
+    test_scatter_prediction();
+    test_frame_window();
+    test_missing_ranges();
+    test_frame_timeout();
+    test_batch_add();
+    test_memory_budget();
+    test_lazy_chunks();
+    test_protocol_v2();
+    test_payload_size();
+    test_fixed_geometry();
+    test_fec();
+    test_nack();
+    test_zerocopy_enobufs();
 
     std::cout << "\n[ALL TESTS PASSED]" << std::endl;
     return 0;
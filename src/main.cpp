@@ -41,7 +41,7 @@ void rx_thread_func(int expected_frames, size_t expected_size) {
 
     while (g_frames_received < expected_frames) {
         // Wait up to 1000ms for a frame
-        std::vector<uint8_t> frame = source.pop_frame(1000);
+        FrameBuffer frame = source.pop_frame(1000);
 
         if (!frame.empty()) {
             // Verify size
@@ -1,7 +1,9 @@
 /**
  * @file rx_benchmark.cpp
- * @brief Pure Performance Receiver using recvmmsg (Linux).
+ * @brief Pure Performance Receiver using recvmmsg or io_uring (Linux).
  * Discards data immediately to measure raw kernel/network speed.
+ * Datagrams larger than the receive buffers are truncated by the kernel: they are counted and reported.
+ * Usage: rx_benchmark [-p PORT] [-m recvmmsg|io_uring] [-s MAX_DATAGRAM]
  */
 
 #ifndef _GNU_SOURCE
@@ -15,18 +17,26 @@
 #include <chrono>
 #include <cstring>
 #include <iomanip>
+#include <string>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <getopt.h>
+
+#include "IoUring.hpp"
+#include "spu_udp_protocol.h"
 
 // Configuration
-const int PORT = 9999;
 const int BATCH_SIZE = 1024; // Huge batch for max throughput
-const size_t PKT_SIZE = 2048; // Max buffer per packet
+size_t g_pkt_size = SPU_UDP_MAX_DATAGRAM; // Max buffer per packet (-s): whole 64 KB datagrams on loopback
+const size_t URING_BUFFER_BYTES = size_t(64) << 20; // Provided buffers (io_uring mode): as many as fit,
+const unsigned URING_MIN_BUFFERS = 64;               // power of two within these bounds
+const unsigned URING_MAX_BUFFERS = 4096;
 
 std::atomic<size_t> g_bytes(0);
 std::atomic<size_t> g_packets(0);
+std::atomic<size_t> g_truncated(0); // Datagrams larger than g_pkt_size
 
 void monitor() {
     auto last_t = std::chrono::steady_clock::now();
@@ -51,65 +61,171 @@ void monitor() {
 
         std::cout << "RX Speed: " << std::fixed << std::setprecision(2)
                   << gbps << " Gbps | "
-                  << std::setprecision(3) << (pps / 1e6) << " Mpps" << std::endl;
+                  << std::setprecision(3) << (pps / 1e6) << " Mpps";
+        size_t truncated = g_truncated.load();
+        if (truncated > 0) std::cout << " | " << truncated << " truncated (raise -s)";
+        std::cout << std::endl;
 
         last_b = cur_b;
         last_t = now;
     }
 }
 
-int main() {
-    // 1. Setup Socket
-    int fd = socket(AF_INET, SOCK_DGRAM, 0);
-
-    // Huge Kernel Buffer
-    int buf_size = 33554432; // 32MB
-    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
-
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(PORT);
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-
-    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        perror("Bind failed");
-        return 1;
-    }
-
-    // 2. Prepare recvmmsg structures
+void run_recvmmsg(int fd) {
     struct mmsghdr msgs[BATCH_SIZE];
     struct iovec iovecs[BATCH_SIZE];
-    std::vector<uint8_t> buffer_pool(BATCH_SIZE * PKT_SIZE);
+    std::vector<uint8_t> buffer_pool(BATCH_SIZE * g_pkt_size);
 
     for (int i = 0; i < BATCH_SIZE; ++i) {
         std::memset(&iovecs[i], 0, sizeof(iovecs[i]));
         std::memset(&msgs[i], 0, sizeof(msgs[i]));
-        iovecs[i].iov_base = &buffer_pool[i * PKT_SIZE];
-        iovecs[i].iov_len = PKT_SIZE;
+        iovecs[i].iov_base = &buffer_pool[i * g_pkt_size];
+        iovecs[i].iov_len = g_pkt_size;
         msgs[i].msg_hdr.msg_iov = &iovecs[i];
         msgs[i].msg_hdr.msg_iovlen = 1;
     }
 
-    std::thread stat_thread(monitor);
-    std::cout << "Benchmarks RX running on port " << PORT << "..." << std::endl;
-
-    // 3. Hot Loop
     while (true) {
         // Block until at least 1 packet arrives, then grab up to 1024
-        int retval = recvmmsg(fd, msgs, BATCH_SIZE, 0, nullptr);
+        int retval = recvmmsg(fd, msgs, BATCH_SIZE, MSG_WAITFORONE, nullptr);
 
         if (retval > 0) {
             size_t batch_bytes = 0;
+            size_t batch_truncated = 0;
             for (int i = 0; i < retval; ++i) {
                 batch_bytes += msgs[i].msg_len;
+                if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) batch_truncated++;
                 // Reset for next call? Not strictly needed for len/flags usually but good practice
                 msgs[i].msg_len = 0;
+                msgs[i].msg_hdr.msg_flags = 0;
             }
             g_bytes += batch_bytes;
             g_packets += retval;
+            if (batch_truncated > 0) g_truncated += batch_truncated;
         }
     }
+}
+
+// Multishot recv into a provided-buffer ring: one SQE, one CQE per datagram.
+// Such a recv truncates silently: one spare byte per buffer tells a datagram larger than g_pkt_size.
+int run_io_uring(int fd) {
+    const size_t stride = g_pkt_size + 1;
+    unsigned buffer_count = URING_MAX_BUFFERS;
+    while (buffer_count > URING_MIN_BUFFERS && buffer_count * stride > URING_BUFFER_BYTES) buffer_count >>= 1;
+
+    std::vector<uint8_t> buffer_pool(buffer_count * stride);
+    IoUring ring(8, 2 * buffer_count);
+    IoUringBufRing buf_ring(ring, buffer_count, 0);
+
+    for (unsigned i = 0; i < buffer_count; ++i)
+        buf_ring.add(&buffer_pool[i * stride], stride, static_cast<uint16_t>(i));
+    buf_ring.publish();
 
+    bool armed = false;
+    bool need_submit = false; // A (re-)armed recv waits in the SQ
+    while (true) {
+        if (!armed) {
+            struct io_uring_sqe* sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = fd;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = 0;
+            armed = true;
+            need_submit = true;
+        }
+
+        if (ring.peek_cqe() == nullptr || need_submit) {
+            int ret = ring.submit(1);
+            need_submit = false;
+            if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+                std::cerr << "io_uring_enter failed: " << std::strerror(-ret) << std::endl;
+                return 1;
+            }
+        }
+
+        size_t batch_bytes = 0;
+        size_t batch_packets = 0;
+        size_t batch_truncated = 0;
+        struct io_uring_cqe* cqe;
+        while ((cqe = ring.peek_cqe()) != nullptr) {
+            if ((cqe->flags & IORING_CQE_F_MORE) == 0) armed = false;
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                uint16_t bid = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                size_t len = static_cast<size_t>(cqe->res);
+                if (len > g_pkt_size) {
+                    len = g_pkt_size;
+                    batch_truncated++;
+                }
+                batch_bytes += len;
+                batch_packets++;
+                buf_ring.add(&buffer_pool[bid * stride], stride, bid);
+            }
+            ring.cq_advance();
+        }
+        buf_ring.publish();
+        g_bytes += batch_bytes;
+        g_packets += batch_packets;
+        if (batch_truncated > 0) g_truncated += batch_truncated;
+    }
+}
+
+int main(int argc, char** argv) {
+    int port = 9999;
+    std::string mode = "recvmmsg";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:m:s:h")) != -1) {
+        switch (opt) {
+            case 'p': port = std::stoi(optarg); break;
+            case 'm': mode = optarg; break;
+            case 's': g_pkt_size = std::stoul(optarg); break;
+            case 'h':
+            default:
+                std::cout << "Usage: " << argv[0] << " -p PORT -m recvmmsg|io_uring -s MAX_DATAGRAM" << std::endl;
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (mode != "recvmmsg" && mode != "io_uring") {
+        std::cerr << "Unknown mode: " << mode << std::endl;
+        return 1;
+    }
+    if (g_pkt_size == 0 || g_pkt_size > 65535) {
+        std::cerr << "Invalid datagram size: " << g_pkt_size << std::endl;
+        return 1;
+    }
+
+    // 1. Setup Socket
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    // Huge Kernel Buffer
+    int buf_size = 33554432; // 32MB
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("Bind failed");
+        return 1;
+    }
+
+    std::thread stat_thread(monitor);
+    stat_thread.detach();
+    std::cout << "Benchmarks RX (" << mode << ") running on port " << port << "..." << std::endl;
+
+    // 2. Hot Loop
+    if (mode == "io_uring") {
+        try {
+            return run_io_uring(fd);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    run_recvmmsg(fd);
     return 0;
-}
\ No newline at end of file
+}